@@ -1,8 +1,13 @@
 use criterion::{black_box, criterion_group, criterion_main, Criterion, Throughput};
 use file_writer::{
-    file_writer_close, file_writer_new, file_writer_write_batch, file_writer_write_large,
-    file_writer_write_raw, file_writer_write_string, BufferDescriptor, FileWriterError,
-    FileWriterHandle, FileWriterMode,
+    file_writer_close, file_writer_csv_row, file_writer_json_begin_object,
+    file_writer_json_end_object, file_writer_json_key, file_writer_json_string,
+    file_writer_json_u64, file_writer_new, file_writer_new_with_options,
+    file_writer_recorder_close, file_writer_recorder_new, file_writer_recorder_write,
+    file_writer_submit, file_writer_write_batch, file_writer_write_f64, file_writer_write_large,
+    file_writer_write_raw, file_writer_write_records, file_writer_write_string,
+    file_writer_write_u64, BufferDescriptor, FileWriterCommand, FileWriterCompression,
+    FileWriterError, FileWriterHandle, FileWriterMode, FileWriterOp, FileWriterOptions,
 };
 use std::{ffi::CString, fs, io::Write, ptr::null_mut};
 use tempfile::NamedTempFile;
@@ -83,6 +88,31 @@ fn file_writer_benchmarks(c: &mut Criterion) {
         teardown_writer(handle);
     });
 
+    let record: Vec<u8> = vec![0x5A; 128];
+
+    group.throughput(Throughput::Bytes(record.len() as u64));
+    group.bench_function("Recorder Write 128 B (64 MiB ring)", |b| {
+        let temp_file = NamedTempFile::new().expect("Failed to create temp file");
+        let c_path = CString::new(temp_file.path().to_str().unwrap()).unwrap();
+        let mut recorder = null_mut();
+        let result =
+            unsafe { file_writer_recorder_new(c_path.as_ptr(), 64 * MIB as u64, &mut recorder) };
+        assert_eq!(result, FileWriterError::Success);
+
+        b.iter(|| {
+            let result = unsafe {
+                file_writer_recorder_write(
+                    recorder,
+                    black_box(record.as_ptr()),
+                    black_box(record.len()),
+                )
+            };
+            black_box(result);
+        });
+
+        unsafe { file_writer_recorder_close(recorder) };
+    });
+
     let size_for_comparison = MIB;
     let data_for_comparison: Vec<u8> = vec![0xCD; size_for_comparison];
 
@@ -164,8 +194,352 @@ fn file_writer_benchmarks(c: &mut Criterion) {
         teardown_writer(handle);
     });
 
+    group.throughput(Throughput::Elements(1));
+    group.bench_function("Write u64", |b| {
+        let temp_file = NamedTempFile::new().expect("Failed to create temp file");
+        let path = temp_file.path().to_str().expect("Path is not valid UTF-8");
+        let (handle, _c_path) = setup_writer(path, FileWriterMode::Write);
+
+        let mut value = 1_234_567_890_123u64;
+        b.iter(|| {
+            value = value.wrapping_add(7919);
+            let result = unsafe { file_writer_write_u64(handle, black_box(value)) };
+            black_box(result);
+        });
+
+        teardown_writer(handle);
+    });
+
+    group.bench_function("Write f64", |b| {
+        let temp_file = NamedTempFile::new().expect("Failed to create temp file");
+        let path = temp_file.path().to_str().expect("Path is not valid UTF-8");
+        let (handle, _c_path) = setup_writer(path, FileWriterMode::Write);
+
+        let mut value = 0.1f64;
+        b.iter(|| {
+            value += 1.000_001;
+            let result = unsafe { file_writer_write_f64(handle, black_box(value)) };
+            black_box(result);
+        });
+
+        teardown_writer(handle);
+    });
+
+    let record_data: Vec<u8> = vec![0x5A; 64];
+    let record_descriptors: Vec<BufferDescriptor> = (0..16)
+        .map(|_| BufferDescriptor {
+            data: record_data.as_ptr(),
+            size: record_data.len(),
+        })
+        .collect();
+
+    group.throughput(Throughput::Elements(record_descriptors.len() as u64));
+    group.bench_function("Write Records 16 x 64 B", |b| {
+        let temp_file = NamedTempFile::new().expect("Failed to create temp file");
+        let path = temp_file.path().to_str().expect("Path is not valid UTF-8");
+        let (handle, _c_path) = setup_writer(path, FileWriterMode::Write);
+
+        b.iter(|| {
+            let result = unsafe {
+                file_writer_write_records(
+                    handle,
+                    black_box(record_descriptors.as_ptr()),
+                    black_box(record_descriptors.len()),
+                )
+            };
+            black_box(result);
+        });
+
+        teardown_writer(handle);
+    });
+
+    // One record as a producer interleaves it: tag, id, payload, padding.
+    let payload = [0x5Au8; 40];
+    let mut submit_commands = [
+        FileWriterCommand {
+            op: FileWriterOp::WriteBytes as u32,
+            data: b"rec ".as_ptr(),
+            value: 4,
+        },
+        FileWriterCommand {
+            op: FileWriterOp::WriteU64 as u32,
+            data: std::ptr::null(),
+            value: 0,
+        },
+        FileWriterCommand {
+            op: FileWriterOp::WriteBytes as u32,
+            data: payload.as_ptr(),
+            value: payload.len() as u64,
+        },
+        FileWriterCommand {
+            op: FileWriterOp::Align as u32,
+            data: std::ptr::null(),
+            value: 8,
+        },
+    ];
+
+    group.throughput(Throughput::Elements(1));
+    group.bench_function("Record as 4 calls", |b| {
+        let temp_file = NamedTempFile::new().expect("Failed to create temp file");
+        let path = temp_file.path().to_str().expect("Path is not valid UTF-8");
+        let (handle, _c_path) = setup_writer(path, FileWriterMode::Write);
+
+        let mut id = 0u64;
+        let zeros = [0u8; 8];
+        let mut written = 0usize;
+        b.iter(|| unsafe {
+            id += 1;
+            let mut digits = itoa::Buffer::new();
+            let digits = digits.format(black_box(id));
+            file_writer_write_raw(handle, b"rec ".as_ptr(), 4);
+            file_writer_write_raw(handle, digits.as_ptr(), digits.len());
+            file_writer_write_raw(handle, payload.as_ptr(), payload.len());
+            written += 4 + digits.len() + payload.len();
+            let pad = (8 - written % 8) % 8;
+            written += pad;
+            black_box(file_writer_write_raw(handle, zeros.as_ptr(), pad));
+        });
+
+        teardown_writer(handle);
+    });
+
+    group.bench_function("Record as 1 submit of 4 commands", |b| {
+        let temp_file = NamedTempFile::new().expect("Failed to create temp file");
+        let path = temp_file.path().to_str().expect("Path is not valid UTF-8");
+        let (handle, _c_path) = setup_writer(path, FileWriterMode::Write);
+
+        let mut id = 0u64;
+        b.iter(|| {
+            id += 1;
+            submit_commands[1].value = black_box(id);
+            let result = unsafe {
+                file_writer_submit(
+                    handle,
+                    black_box(submit_commands.as_ptr()),
+                    submit_commands.len(),
+                )
+            };
+            black_box(result);
+        });
+
+        teardown_writer(handle);
+    });
+
+    // A typical row: mostly plain fields, one needing quotes.
+    let csv_fields: [&[u8]; 8] = [
+        b"2024-03-01T12:00:00Z",
+        b"42",
+        b"GET",
+        b"/api/v1/items?page=3",
+        b"200",
+        b"Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36",
+        b"said \"hello, world\"",
+        b"0.0123",
+    ];
+    let csv_descriptors: Vec<BufferDescriptor> = csv_fields
+        .iter()
+        .map(|f| BufferDescriptor {
+            data: f.as_ptr(),
+            size: f.len(),
+        })
+        .collect();
+
+    group.throughput(Throughput::Elements(1));
+    group.bench_function("CSV Row 8 fields", |b| {
+        let temp_file = NamedTempFile::new().expect("Failed to create temp file");
+        let path = temp_file.path().to_str().expect("Path is not valid UTF-8");
+        let (handle, _c_path) = setup_writer(path, FileWriterMode::Write);
+
+        b.iter(|| {
+            let result = unsafe {
+                file_writer_csv_row(
+                    handle,
+                    black_box(csv_descriptors.as_ptr()),
+                    black_box(csv_descriptors.len()),
+                )
+            };
+            black_box(result);
+        });
+
+        teardown_writer(handle);
+    });
+
+    let json_members: [(&str, &str); 4] = [
+        ("level", "info"),
+        ("path", "/api/v1/items?page=3"),
+        (
+            "agent",
+            "Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36",
+        ),
+        ("msg", "request \"GET /items\" completed"),
+    ];
+
+    group.throughput(Throughput::Elements(1));
+    group.bench_function("JSON Line 5 members", |b| {
+        let temp_file = NamedTempFile::new().expect("Failed to create temp file");
+        let path = temp_file.path().to_str().expect("Path is not valid UTF-8");
+        let (handle, _c_path) = setup_writer(path, FileWriterMode::Write);
+
+        let mut id = 0u64;
+        b.iter(|| unsafe {
+            id += 1;
+            file_writer_json_begin_object(handle);
+            file_writer_json_key(handle, "id".as_ptr().cast(), 2);
+            file_writer_json_u64(handle, black_box(id));
+            for (key, value) in black_box(&json_members) {
+                file_writer_json_key(handle, key.as_ptr().cast(), key.len());
+                file_writer_json_string(handle, value.as_ptr().cast(), value.len());
+            }
+            black_box(file_writer_json_end_object(handle));
+        });
+
+        teardown_writer(handle);
+    });
+
     group.finish();
 }
 
-criterion_group!(benches, file_writer_benchmarks);
+/// Log-like input, roughly 10:1 compressible.
+fn log_data(size: usize) -> Vec<u8> {
+    let mut data = Vec::with_capacity(size);
+    let mut line = 0u64;
+    while data.len() < size {
+        let entry = format!(
+            "2024-05-01T12:{:02}:{:02}.{:03}Z INFO worker={} request id={:x} served in {}ms\n",
+            line / 60 % 60,
+            line % 60,
+            line % 1000,
+            line % 32,
+            line.wrapping_mul(0x9E37_79B9_7F4A_7C15),
+            line % 97
+        );
+        data.extend_from_slice(entry.as_bytes());
+        line += 1;
+    }
+    data.truncate(size);
+    data
+}
+
+fn setup_compressed_writer(path: &str, options: &FileWriterOptions) -> *mut FileWriterHandle {
+    let c_path = CString::new(path).expect("CString::new failed");
+    let mut handle: *mut FileWriterHandle = null_mut();
+    let result = unsafe {
+        file_writer_new_with_options(c_path.as_ptr(), &mut handle, FileWriterMode::Write, options)
+    };
+    assert_eq!(result, FileWriterError::Success, "Failed to create writer");
+    handle
+}
+
+/// Throughput of each codec built in, with the compression ratio it reached
+/// printed alongside, and of uncompressed output with CRC32C block trailers.
+fn codec_benchmarks(c: &mut Criterion) {
+    let mut group = c.benchmark_group("Codecs");
+    group.sample_size(20);
+
+    let data = log_data(4 * MIB);
+    let codecs = [
+        ("none", FileWriterCompression::None, 0, 0),
+        (
+            "none+crc32c",
+            FileWriterCompression::None,
+            0,
+            64 * KIB as u32,
+        ),
+        ("lz4", FileWriterCompression::Lz4, 0, 0),
+        ("zstd-1", FileWriterCompression::Zstd, 1, 0),
+        ("zstd-3", FileWriterCompression::Zstd, 3, 0),
+    ];
+
+    group.throughput(Throughput::Bytes(data.len() as u64));
+    for (name, compression, level, crc_block_size) in codecs {
+        let options = FileWriterOptions {
+            compression: compression as u32,
+            compression_level: level,
+            crc_block_size,
+            ..Default::default()
+        };
+        // Skip codecs whose cargo feature this build lacks.
+        let probe = NamedTempFile::new().expect("Failed to create temp file");
+        let c_probe = CString::new(probe.path().to_str().unwrap()).unwrap();
+        let mut handle: *mut FileWriterHandle = null_mut();
+        match unsafe {
+            file_writer_new_with_options(
+                c_probe.as_ptr(),
+                &mut handle,
+                FileWriterMode::Write,
+                &options,
+            )
+        } {
+            FileWriterError::Success => teardown_writer(handle),
+            _ => continue,
+        }
+
+        group.bench_function(name, |b| {
+            let temp_file = NamedTempFile::new().expect("Failed to create temp file");
+            let path = temp_file.path().to_str().expect("Path is not valid UTF-8");
+            let handle = setup_compressed_writer(path, &options);
+
+            let mut written = 0u64;
+            b.iter(|| {
+                let result = unsafe {
+                    file_writer_write_raw(handle, black_box(data.as_ptr()), black_box(data.len()))
+                };
+                written += data.len() as u64;
+                black_box(result);
+            });
+
+            teardown_writer(handle);
+            let stored = fs::metadata(path).map_or(0, |m| m.len()).max(1);
+            println!("{name}: ratio {:.2}", written as f64 / stored as f64);
+        });
+    }
+
+    group.finish();
+}
+
+/// Compressed write throughput against the number of compression threads.
+#[cfg(feature = "zstd")]
+fn compression_benchmarks(c: &mut Criterion) {
+    use criterion::BenchmarkId;
+
+    let mut group = c.benchmark_group("Parallel zstd");
+    group.sample_size(20);
+
+    let data = log_data(4 * MIB);
+    group.throughput(Throughput::Bytes(data.len() as u64));
+    for threads in [1u32, 2, 4, 8, 16, 32] {
+        group.bench_with_input(BenchmarkId::new("threads", threads), &threads, |b, &t| {
+            let temp_file = NamedTempFile::new().expect("Failed to create temp file");
+            let path = temp_file.path().to_str().expect("Path is not valid UTF-8");
+            let options = FileWriterOptions {
+                compression: FileWriterCompression::Zstd as u32,
+                compression_level: 3,
+                compression_threads: t,
+                ..Default::default()
+            };
+            let handle = setup_compressed_writer(path, &options);
+
+            b.iter(|| {
+                let result = unsafe {
+                    file_writer_write_raw(handle, black_box(data.as_ptr()), black_box(data.len()))
+                };
+                black_box(result);
+            });
+
+            teardown_writer(handle);
+        });
+    }
+
+    group.finish();
+}
+
+#[cfg(not(feature = "zstd"))]
+fn compression_benchmarks(_c: &mut Criterion) {}
+
+criterion_group!(
+    benches,
+    file_writer_benchmarks,
+    codec_benchmarks,
+    compression_benchmarks
+);
 criterion_main!(benches);
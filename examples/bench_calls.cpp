@@ -0,0 +1,53 @@
+// Per-call cost of small writes through the C API: each call into the library against
+// file_writer_write_inline, which is inlined into the caller.
+#include "file_writer/file_writer.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+namespace {
+
+constexpr const char* bench_filename = "bench_calls.bin";
+constexpr int calls = 20'000'000;
+
+template <typename F>
+void bench(const char* name, F&& write) {
+    FileWriterHandle* handle = nullptr;
+    if (file_writer_new(bench_filename, &handle, Write) != Success) {
+        std::fprintf(stderr, "cannot open %s\n", bench_filename);
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < calls; ++i) {
+        write(handle, static_cast<uint64_t>(i));
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    file_writer_close(handle);
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count() / calls;
+    std::printf("%-36s %6.2f ns/call\n", name, ns);
+}
+
+} // namespace
+
+int main() {
+    const uint8_t bytes[8] = {'0', '1', '2', '3', '4', '5', '6', '\n'};
+
+    bench("file_writer_write_raw (8 B)", [&](FileWriterHandle* h, uint64_t) {
+        file_writer_write_raw(h, bytes, sizeof(bytes));
+    });
+    bench("file_writer_write_inline (8 B)", [&](FileWriterHandle* h, uint64_t) {
+        file_writer_write_inline(h, bytes, sizeof(bytes));
+    });
+    bench("file_writer_write_u64", [](FileWriterHandle* h, uint64_t i) {
+        file_writer_write_u64(h, i);
+    });
+    bench("file_writer_put_char", [](FileWriterHandle* h, uint64_t i) {
+        file_writer_put_char(h, static_cast<char>('a' + i % 26));
+    });
+
+    std::remove(bench_filename);
+    return 0;
+}
@@ -1,10 +1,16 @@
 #include "file_writer/file_writer.h"
+#include "file_writer/file_writer.hpp"
+#include "file_writer/schema.hpp"
 #include <catch2/catch_test_macros.hpp>
 #include <string>
 #include <vector>
 #include <fstream>
 #include <iostream>
 #include <cstdio>
+#include <algorithm>
+#if __has_include(<format>)
+#include <format>
+#endif
 
 std::string readFileContent(const std::string& filename) {
     std::ifstream ifs(filename, std::ios::binary);
@@ -135,6 +141,29 @@ TEST_CASE("FileWriter Basic Operations", "[file_writer]") {
         REQUIRE(content == long_message + message2);
     }
 
+    SECTION("Printf") {
+        err = file_writer_new(test_filename, &handle, FileWriterMode::Write);
+        REQUIRE(err == FileWriterError::Success);
+
+        err = file_writer_set_buffer_size(handle, 64);
+        REQUIRE(err == FileWriterError::Success);
+
+        err = file_writer_printf(handle, "ts=%d id=%s\n", 42, "abc");
+        REQUIRE(err == FileWriterError::Success);
+
+        // Longer than the buffer: the second pass formats into a grown one.
+        std::string long_message(300, 'Y');
+        err = file_writer_printf(handle, "%s|%.2f\n", long_message.c_str(), 1.5);
+        REQUIRE(err == FileWriterError::Success);
+
+        err = file_writer_close(handle);
+        REQUIRE(err == FileWriterError::Success);
+        handle = nullptr;
+
+        std::string content = readFileContent(test_filename);
+        REQUIRE(content == "ts=42 id=abc\n" + long_message + "|1.50\n");
+    }
+
 
     SECTION("Error Handling - Invalid Path") {
         err = file_writer_new(nullptr, &handle, FileWriterMode::Write);
@@ -160,4 +189,289 @@ TEST_CASE("FileWriter Basic Operations", "[file_writer]") {
         file_writer_close(handle);
     }
     cleanupFile(test_filename);
-}
\ No newline at end of file
+}
+
+TEST_CASE("Compile-time format", "[file_writer][format]") {
+    const char* test_filename = "test_format.txt";
+    cleanupFile(test_filename);
+
+    FileWriterHandle* handle = nullptr;
+    REQUIRE(file_writer_new(test_filename, &handle, FileWriterMode::Write) == FileWriterError::Success);
+
+    std::string msg = "hello";
+    FileWriterError err = fw::format<"ts={} id={} msg={}\n">(handle, 1700000000123ULL, -42, msg);
+    REQUIRE(err == FileWriterError::Success);
+
+    err = fw::format<"{}{}|{{{}}}|{}\n">(handle, 'c', true, "lit", 0.25);
+    REQUIRE(err == FileWriterError::Success);
+
+    err = fw::format<"no args\n">(handle);
+    REQUIRE(err == FileWriterError::Success);
+
+    // Longer than the buffer: the reservation grows it.
+    REQUIRE(file_writer_set_buffer_size(handle, 16) == FileWriterError::Success);
+    std::string long_message(100, 'Z');
+    err = fw::format<"[{}]\n">(handle, std::string_view(long_message));
+    REQUIRE(err == FileWriterError::Success);
+
+    REQUIRE(file_writer_close(handle) == FileWriterError::Success);
+
+    std::string content = readFileContent(test_filename);
+    REQUIRE(content == "ts=1700000000123 id=-42 msg=hello\n"
+                       "ctrue|{lit}|0.25\n"
+                       "no args\n"
+                       "[" + long_message + "]\n");
+    cleanupFile(test_filename);
+}
+
+TEST_CASE("RAII Writer", "[file_writer][cpp]") {
+    const char* test_filename = "test_writer.txt";
+    cleanupFile(test_filename);
+
+    SECTION("Writes and closes on destruction") {
+        {
+            fw::Writer writer;
+            REQUIRE_FALSE(writer);
+            REQUIRE(fw::Writer::open(test_filename, FileWriterMode::Write, writer) == FileWriterError::Success);
+            REQUIRE(writer);
+
+            std::string text = "abc";
+            REQUIRE(writer.write(std::string_view(text).substr(1)) == FileWriterError::Success);
+
+            const std::byte bytes[] = {std::byte{'-'}, std::byte{'>'}};
+            REQUIRE(writer.write(std::span<const std::byte>(bytes)) == FileWriterError::Success);
+
+            std::string_view id = "42";
+            REQUIRE(writer.write_batch("id=", id, std::span<const std::byte>(bytes)) == FileWriterError::Success);
+
+            std::vector<std::string_view> parts(40, "x");
+            REQUIRE(writer.write_batch(std::span<const std::string_view>(parts)) == FileWriterError::Success);
+
+            REQUIRE(writer.format<"|{}\n">(7) == FileWriterError::Success);
+        }
+        REQUIRE(readFileContent(test_filename) == "bc->id=42->" + std::string(40, 'x') + "|7\n");
+    }
+
+    SECTION("Moves transfer ownership") {
+        fw::Writer first;
+        REQUIRE(fw::Writer::open(test_filename, FileWriterMode::Write, first) == FileWriterError::Success);
+        FileWriterHandle* handle = first.get();
+
+        fw::Writer second = std::move(first);
+        REQUIRE_FALSE(first);
+        REQUIRE(second.get() == handle);
+        REQUIRE(first.write("ignored") == FileWriterError::InvalidHandle);
+
+        REQUIRE(second.write("moved") == FileWriterError::Success);
+        first = std::move(second);
+        REQUIRE(first.close() == FileWriterError::Success);
+        REQUIRE(first.close() == FileWriterError::Success);
+        REQUIRE(readFileContent(test_filename) == "moved");
+    }
+
+    cleanupFile(test_filename);
+}
+
+TEST_CASE("Inline small writes", "[file_writer][inline]") {
+    const char* test_filename = "test_inline.txt";
+    cleanupFile(test_filename);
+
+    FileWriterHandle* handle = nullptr;
+    REQUIRE(file_writer_new(test_filename, &handle, FileWriterMode::Write) == FileWriterError::Success);
+    REQUIRE(file_writer_set_buffer_size(handle, 64) == FileWriterError::Success);
+
+    // Many more bytes than the buffer holds: the full buffer is handed to the library each time.
+    std::string expected;
+    for (int i = 0; i < 100; ++i) {
+        const char word[] = "tick ";
+        REQUIRE(file_writer_write_inline(handle, word, 5) == FileWriterError::Success);
+        REQUIRE(file_writer_put_char(handle, static_cast<char>('0' + i % 10)) == FileWriterError::Success);
+        expected += "tick ";
+        expected += static_cast<char>('0' + i % 10);
+    }
+    // Mixed with ordinary calls, in order.
+    REQUIRE(file_writer_write_string(handle, "|end") == FileWriterError::Success);
+    REQUIRE(file_writer_close(handle) == FileWriterError::Success);
+
+    REQUIRE(readFileContent(test_filename) == expected + "|end");
+    REQUIRE(file_writer_write_inline(nullptr, "x", 1) == FileWriterError::InvalidHandle);
+    cleanupFile(test_filename);
+}
+
+TEST_CASE("Stream adapters", "[file_writer][stream]") {
+    const char* test_filename = "test_stream.txt";
+    cleanupFile(test_filename);
+
+    SECTION("ofstream") {
+        {
+            fw::ofstream out(test_filename);
+            REQUIRE(out.is_open());
+            out << "int=" << 42 << " double=" << 1.5 << ' ' << std::string(200, 'S') << std::endl;
+            out << "after flush\n";
+        }
+        {
+            fw::ofstream out(test_filename, std::ios_base::app);
+            out << "appended";
+            out.close();
+            REQUIRE(out.good());
+            REQUIRE_FALSE(out.is_open());
+        }
+        REQUIRE(readFileContent(test_filename) ==
+                "int=42 double=1.5 " + std::string(200, 'S') + "\nafter flush\nappended");
+    }
+
+    SECTION("streambuf on a handle shared with direct writes") {
+        fw::Writer writer;
+        REQUIRE(fw::Writer::open(test_filename, FileWriterMode::Write, writer) == FileWriterError::Success);
+        REQUIRE(file_writer_set_buffer_size(writer.get(), 32) == FileWriterError::Success);
+        {
+            fw::streambuf buf(writer.get());
+            std::ostream out(&buf);
+            for (int i = 0; i < 20; ++i) {
+                out << "line " << i << '\n';
+            }
+            REQUIRE(buf.commit() == FileWriterError::Success);
+            REQUIRE(writer.write("direct\n") == FileWriterError::Success);
+            out << std::string(100 * 1024, 'L') << '\n';
+        }
+        REQUIRE(writer.close() == FileWriterError::Success);
+
+        std::string expected;
+        for (int i = 0; i < 20; ++i) {
+            expected += "line " + std::to_string(i) + "\n";
+        }
+        expected += "direct\n" + std::string(100 * 1024, 'L') + "\n";
+        REQUIRE(readFileContent(test_filename) == expected);
+    }
+
+    cleanupFile(test_filename);
+}
+
+TEST_CASE("Output iterator", "[file_writer][iterator]") {
+    const char* test_filename = "test_iterator.txt";
+    cleanupFile(test_filename);
+
+    {
+        fw::Writer writer;
+        REQUIRE(fw::Writer::open(test_filename, FileWriterMode::Write, writer) == FileWriterError::Success);
+        REQUIRE(file_writer_set_buffer_size(writer.get(), 16) == FileWriterError::Success);
+
+        std::string text = "copied through the iterator, longer than the buffer\n";
+        fw::buffer_iterator it = std::copy(text.begin(), text.end(), writer.out());
+        REQUIRE(it.error() == FileWriterError::Success);
+
+        // The constrained algorithms check the same std::output_iterator concept format_to does.
+        std::string more = "ranges::copy, " + std::string(40, 'r') + "\n";
+        it = std::ranges::copy(more, writer.out()).out;
+        REQUIRE(it.error() == FileWriterError::Success);
+        text += more;
+
+#if defined(__cpp_lib_format)
+        it = std::format_to(writer.out(), "{}={:>5}|{}\n", "n", 42, std::string(100, 'F'));
+        REQUIRE(it.error() == FileWriterError::Success);
+        text += "n=   42|" + std::string(100, 'F') + "\n";
+#endif
+        REQUIRE(writer.close() == FileWriterError::Success);
+        REQUIRE(readFileContent(test_filename) == text);
+    }
+
+    fw::buffer_iterator closed;
+    *closed = 'x';
+    REQUIRE(closed.error() == FileWriterError::InvalidHandle);
+    cleanupFile(test_filename);
+}
+
+TEST_CASE("Typed binary writes", "[file_writer][binary]") {
+    const char* test_filename = "test_pod.bin";
+    cleanupFile(test_filename);
+
+    struct Sample {
+        uint64_t ts;
+        uint32_t id;
+        float value;
+    };
+    static_assert(sizeof(Sample) == 16, "no padding expected");
+
+    {
+        fw::Writer writer;
+        REQUIRE(fw::Writer::open(test_filename, FileWriterMode::Write, writer) == FileWriterError::Success);
+        REQUIRE(writer.write_pod(uint8_t{0xAB}) == FileWriterError::Success);
+        REQUIRE(writer.write_pod(uint16_t{0x0102}) == FileWriterError::Success);
+        REQUIRE(writer.write_pod(Sample{1700000000, 7, 0.5f}) == FileWriterError::Success);
+
+        std::vector<uint32_t> ids = {1, 2, 3, 4};
+        REQUIRE(writer.write_range(ids) == FileWriterError::Success);
+        const Sample samples[] = {{1, 1, 1.0f}, {2, 2, 2.0f}};
+        REQUIRE(writer.write_range(samples) == FileWriterError::Success);
+        REQUIRE(writer.write_range(std::vector<double>{}) == FileWriterError::Success);
+        REQUIRE(writer.close() == FileWriterError::Success);
+    }
+
+    std::string content = readFileContent(test_filename);
+    REQUIRE(content.size() == 1 + 2 + 16 + 4 * 4 + 2 * 16);
+
+    Sample sample;
+    memcpy(&sample, content.data() + 3, sizeof(sample));
+    REQUIRE(sample.ts == 1700000000);
+    REQUIRE(sample.id == 7);
+    REQUIRE(sample.value == 0.5f);
+
+    uint32_t third;
+    memcpy(&third, content.data() + 19 + 8, sizeof(third));
+    REQUIRE(third == 3);
+
+    memcpy(&sample, content.data() + 35 + 16, sizeof(sample));
+    REQUIRE(sample.ts == 2);
+    cleanupFile(test_filename);
+}
+
+TEST_CASE("Schema rows", "[file_writer][schema]") {
+    const char* test_filename = "test_schema.bin";
+    cleanupFile(test_filename);
+
+    namespace fs = fw::schema;
+    using Tick = fs::row<fs::field<"ts", uint64_t>,
+                         fs::field<"id", uint32_t, fs::big_endian>,
+                         fs::pad<4>,
+                         fs::field<"price", double>,
+                         fs::text<"sym", 4>,
+                         fs::field<"qty", int16_t, fs::big_endian>>;
+    static_assert(Tick::size == 8 + 4 + 4 + 8 + 4 + 2);
+    static_assert(Tick::offsets[3] == 16 && Tick::offsets[5] == 28);
+    static_assert(Tick::header_size == 12 + 6 * 9 + 2 + 2 + 5 + 3 + 3);
+
+    const int rows = 1000;
+    {
+        fw::Writer writer;
+        REQUIRE(fw::Writer::open(test_filename, FileWriterMode::Write, writer) == FileWriterError::Success);
+        REQUIRE(Tick::write_header(writer.get()) == FileWriterError::Success);
+        for (int i = 0; i < rows; ++i) {
+            REQUIRE(Tick::write(writer.get(), uint64_t(i), uint32_t(0x01020304), i * 0.5,
+                                i % 2 ? "AAPL" : "MSFTX", int16_t(-2)) == FileWriterError::Success);
+        }
+        REQUIRE(writer.close() == FileWriterError::Success);
+    }
+    REQUIRE(Tick::write(nullptr, uint64_t(0), 0u, 0.0, "", int16_t(0)) == FileWriterError::InvalidHandle);
+
+    std::string content = readFileContent(test_filename);
+    REQUIRE(content.size() == Tick::header_size + rows * Tick::size);
+    REQUIRE(content.compare(0, 4, "FWSC") == 0);
+    REQUIRE(uint8_t(content[6]) == 6);
+    REQUIRE(uint8_t(content[8]) == Tick::size);
+    // First field: u64, little-endian, 8 bytes at 0, named "ts".
+    REQUIRE(content.compare(12, 11, std::string("\x04\x00\x08\x00\x00\x00\x00\x00\x02ts", 11)) == 0);
+
+    const char* row = content.data() + Tick::header_size + 3 * Tick::size;
+    uint64_t ts;
+    memcpy(&ts, row, 8);
+    REQUIRE(ts == 3);
+    REQUIRE(std::string(row + 8, 4) == "\x01\x02\x03\x04");
+    REQUIRE(std::string(row + 12, 4) == std::string(4, '\0'));
+    double price;
+    memcpy(&price, row + 16, 8);
+    REQUIRE(price == 1.5);
+    REQUIRE(std::string(row + 24, 4) == "AAPL");
+    REQUIRE(std::string(row + 28, 2) == "\xFF\xFE");
+    REQUIRE(std::string(row - Tick::size + 24, 4) == "MSFT");
+    cleanupFile(test_filename);
+}
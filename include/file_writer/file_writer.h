@@ -1,8 +1,12 @@
 #ifndef FILE_WRITER_H
 #define FILE_WRITER_H
 
+#include <stdarg.h> // for va_list
+#include <stdbool.h> // for bool
 #include <stddef.h> // for size_t
 #include <stdint.h> // for uint8_t
+#include <stdio.h> // for vsnprintf
+#include <string.h> // for memcpy
 
 #ifdef __cplusplus
 extern "C" {
@@ -17,6 +21,7 @@ typedef enum FileWriterError {
     InvalidPath = 5,
     InvalidData = 6,
     IoError = 7,
+    UnsupportedOption = 8, // option needs a cargo feature this build lacks
 } FileWriterError;
 
 typedef enum FileWriterMode {
@@ -29,14 +34,168 @@ typedef struct FileWriterHandle FileWriterHandle;
 
 FileWriterError file_writer_new(const char* path, FileWriterHandle** handle, FileWriterMode mode);
 
+typedef enum FileWriterCompression {
+    CompressionNone = 0,
+    CompressionZstd = 1, // needs the `zstd` cargo feature (FILE_WRITER_FEATURES=zstd)
+    // zstd seekable format: 1 MiB blocks plus a seek table on close. Not with Append or CRC blocks.
+    CompressionZstdSeekable = 2,
+    CompressionLz4 = 3, // LZ4 frames; needs the `lz4` cargo feature, ignores level/threads
+} FileWriterCompression;
+
+typedef enum FileWriterDigest {
+    DigestNone = 0,
+    DigestXxh3_128 = 1, // 16 bytes, big-endian (as `xxhsum -H2` prints)
+    DigestBlake3 = 2,   // 32 bytes; needs the `blake3` cargo feature
+} FileWriterDigest;
+
+#define FILE_WRITER_DIGEST_MAX_SIZE 32
+
+// Zero-initialise for the defaults.
+typedef struct FileWriterOptions {
+    uint32_t compression; // a FileWriterCompression; other values return InvalidData
+    int32_t compression_level; // 0 = codec default
+    // >1: compress independent 1 MiB blocks on this many threads (at most one per CPU), written
+    // in order.
+    uint32_t compression_threads;
+    // Non-zero: follow every this many output bytes with a CRC32C trailer (see file_writer_verify).
+    // Not with Append.
+    uint32_t crc_block_size;
+    // A FileWriterDigest: hash the bytes this handle writes as they reach the file; returned by
+    // file_writer_close_digest. Other values return InvalidData.
+    uint32_t digest;
+} FileWriterOptions;
+
+// `options` may be NULL. With compression, every flush/sync/close ends a frame, so the
+// file is a valid multi-frame stream after each of them.
+FileWriterError file_writer_new_with_options(const char* path, FileWriterHandle** handle,
+                                             FileWriterMode mode, const FileWriterOptions* options);
+
+// Splits output into `dir`/`name_template` segments of at most `segment_size` bytes;
+// `{}` in the template is replaced by the segment index. The next segment is
+// pre-created in the background, so rollover does not stall the writer; if it is not
+// ready yet, writes continue in the current segment, which may then exceed `segment_size`.
+FileWriterError file_writer_new_segmented(const char* dir, const char* name_template,
+                                          uint64_t segment_size, FileWriterHandle** handle);
+
+// Switches to `dir`/`pattern` for each new `period_secs` interval (UTC, epoch-aligned);
+// `pattern` expands %Y %m %d %H %M %S. The next file is opened in the background
+// before the boundary; the switch happens on the first write after it (once that file is
+// open; writes never wait for it).
+FileWriterError file_writer_new_rotating(const char* dir, const char* pattern,
+                                         uint64_t period_secs, FileWriterHandle** handle);
+
+// For segmented/rotating handles: delete the oldest files in the background once there are
+// more than `max_files` (including the current one) or closed files exceed `max_bytes`.
+// 0 disables a limit. Deletion is throttled to `delete_bytes_per_sec` (0 = unthrottled).
+FileWriterError file_writer_set_retention(FileWriterHandle* handle, uint64_t max_files,
+                                          uint64_t max_bytes, uint64_t delete_bytes_per_sec);
+
 FileWriterError file_writer_set_buffer_size(FileWriterHandle* handle, size_t size);
 
 FileWriterError file_writer_write_raw(FileWriterHandle* handle, const uint8_t* data, size_t size);
 
 FileWriterError file_writer_write_string(FileWriterHandle* handle, const char* str);
 
+// Like file_writer_write_string for text of known length: no NUL terminator needed or scanned for.
+FileWriterError file_writer_write_string_n(FileWriterHandle* handle, const char* str, size_t len);
+
+// Every handle starts with this view of its write buffer: `pos` bytes at `data` are buffered,
+// and a write of n bytes may be copied in place while pos <= cap and n <= cap - pos (not
+// pos + n <= cap, which can wrap). `cap` is 0 when every write must go through the library
+// (segmented/timed handles, failed handles), and `pos` may then be larger.
+typedef struct FileWriterCursor {
+    uint8_t* data;
+    size_t pos;
+    size_t cap;
+} FileWriterCursor;
+
+// file_writer_write_raw for small writes: a memcpy into the buffer, calling into the library
+// only when it is full (or the handle is NULL or cannot take inline writes).
+static inline FileWriterError file_writer_write_inline(FileWriterHandle* handle, const void* data,
+                                                       size_t size) {
+    FileWriterCursor* cursor = (FileWriterCursor*)handle;
+    if (handle != NULL && cursor->pos <= cursor->cap && size <= cursor->cap - cursor->pos) {
+        memcpy(cursor->data + cursor->pos, data, size);
+        cursor->pos += size;
+        return Success;
+    }
+    return file_writer_write_raw(handle, (const uint8_t*)data, size);
+}
+
+static inline FileWriterError file_writer_put_char(FileWriterHandle* handle, char c) {
+    FileWriterCursor* cursor = (FileWriterCursor*)handle;
+    if (handle != NULL && cursor->pos < cursor->cap) {
+        cursor->data[cursor->pos++] = (uint8_t)c;
+        return Success;
+    }
+    return file_writer_write_raw(handle, (const uint8_t*)&c, 1);
+}
+
+// Decimal text, formatted straight into the handle's buffer (no snprintf, no NUL scan).
+FileWriterError file_writer_write_u64(FileWriterHandle* handle, uint64_t value);
+
+FileWriterError file_writer_write_i64(FileWriterHandle* handle, int64_t value);
+
+// Shortest round-trip form (Ryu): 0.1, 3.0, 1e300; NaN, inf, -inf.
+FileWriterError file_writer_write_f64(FileWriterHandle* handle, double value);
+
 FileWriterError file_writer_flush(FileWriterHandle* handle);
 
+// Flush plus fdatasync: acknowledged data survives power loss, not just a process crash.
+FileWriterError file_writer_sync(FileWriterHandle* handle);
+
+// Writing in place: reserve hands out at least `min_size` bytes of free buffer space (flushing
+// the buffer, or growing it until the commit, as needed) in `*data`, `*available` bytes in all;
+// commit then adds the first `size` of them to the output. Make no other call on the handle in
+// between. Segmented handles count only committed bytes and switch files at the commit.
+FileWriterError file_writer_reserve(FileWriterHandle* handle, size_t min_size, uint8_t** data,
+                                    size_t* available);
+
+FileWriterError file_writer_commit(FileWriterHandle* handle, size_t size);
+
+// printf formatted straight into the handle's buffer: no temporary and, unless the output is
+// longer than the free space, a single formatting pass. The first pass takes whatever space is
+// free, so it never grows the buffer; output larger than the whole buffer is written out at the
+// commit and the buffer shrinks back.
+static inline FileWriterError file_writer_vprintf(FileWriterHandle* handle, const char* format,
+                                                  va_list args) {
+    uint8_t* data;
+    size_t available;
+    FileWriterError err = file_writer_reserve(handle, 1, &data, &available);
+    if (err != Success) {
+        return err;
+    }
+    va_list again;
+    va_copy(again, args);
+    int len = vsnprintf((char*)data, available, format, args);
+    if (len >= 0 && (size_t)len >= available) {
+        // vsnprintf also writes a NUL, which is not committed.
+        err = file_writer_reserve(handle, (size_t)len + 1, &data, &available);
+        if (err == Success) {
+            len = vsnprintf((char*)data, available, format, again);
+        }
+    }
+    va_end(again);
+    if (err != Success) {
+        return err;
+    }
+    if (len < 0) {
+        return InvalidData;
+    }
+    return file_writer_commit(handle, (size_t)len);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((format(printf, 2, 3)))
+#endif
+static inline FileWriterError file_writer_printf(FileWriterHandle* handle, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    FileWriterError err = file_writer_vprintf(handle, format, args);
+    va_end(args);
+    return err;
+}
+
 typedef struct BufferDescriptor {
     const uint8_t* data;
     size_t size;
@@ -46,8 +205,94 @@ FileWriterError file_writer_write_batch(FileWriterHandle* handle, const BufferDe
 
 FileWriterError file_writer_write_large(FileWriterHandle* handle, const uint8_t* data, size_t size);
 
+typedef enum FileWriterOp {
+    OpWriteBytes = 0,  // `value` bytes at `data`
+    OpWriteString = 1, // the NUL-terminated string at `data`
+    OpWriteU64 = 2,    // `value` in decimal
+    OpAlign = 3,       // zero bytes up to a multiple of `value` (non-zero) from the file's start
+    OpFlush = 4,
+} FileWriterOp;
+
+typedef struct FileWriterCommand {
+    uint32_t op; // a FileWriterOp; other values return InvalidData
+    const uint8_t* data;
+    uint64_t value;
+} FileWriterCommand;
+
+// Runs `count` commands in order in one call; stops at the first that fails and returns its
+// error (the ones before it are done).
+FileWriterError file_writer_submit(FileWriterHandle* handle, const FileWriterCommand* commands, size_t count);
+
+// Writes a record: LEB128 varint of `size`, then the payload.
+FileWriterError file_writer_write_record(FileWriterHandle* handle, const uint8_t* data, size_t size);
+
+// Writes one record per descriptor in a single call.
+FileWriterError file_writer_write_records(FileWriterHandle* handle, const BufferDescriptor* records, size_t count);
+
+// CSV: fields containing the delimiter, quote, CR or LF are quoted (quotes doubled); rows end
+// in "\n". The defaults are ',' and '"'.
+FileWriterError file_writer_csv_set_format(FileWriterHandle* handle, char delimiter, char quote);
+
+FileWriterError file_writer_csv_row(FileWriterHandle* handle, const BufferDescriptor* fields, size_t count);
+
+// JSON Lines, built in order: begin_object, then key + value pairs (a value may itself be an
+// object), then end_object, which ends the line after the outermost object. Strings are
+// `size` bytes of UTF-8, escaped as needed. Calls out of order return InvalidData. The line is
+// held by the handle and written whole when it ends; until then nothing of it is in the file.
+FileWriterError file_writer_json_begin_object(FileWriterHandle* handle);
+
+FileWriterError file_writer_json_end_object(FileWriterHandle* handle);
+
+FileWriterError file_writer_json_key(FileWriterHandle* handle, const char* key, size_t size);
+
+FileWriterError file_writer_json_string(FileWriterHandle* handle, const char* value, size_t size);
+
+FileWriterError file_writer_json_i64(FileWriterHandle* handle, int64_t value);
+
+FileWriterError file_writer_json_u64(FileWriterHandle* handle, uint64_t value);
+
+// NaN and infinities are not JSON numbers and return InvalidData.
+FileWriterError file_writer_json_f64(FileWriterHandle* handle, double value);
+
+FileWriterError file_writer_json_bool(FileWriterHandle* handle, bool value);
+
+// Drops the unfinished JSON line, e.g. after an InvalidData, so the next begin_object starts a
+// new one.
+FileWriterError file_writer_json_abort(FileWriterHandle* handle);
+
 FileWriterError file_writer_close(FileWriterHandle* handle);
 
+// Closes like file_writer_close and returns the digest of the bytes this handle wrote: the whole
+// file, except that with Append the bytes already in it are left out. `digest` must hold
+// FILE_WRITER_DIGEST_MAX_SIZE bytes; `*digest_len` is 0 if no digest was configured.
+FileWriterError file_writer_close_digest(FileWriterHandle* handle, uint8_t* digest, size_t* digest_len);
+
+// Reads decompressed bytes [offset, offset + size) of a closed CompressionZstdSeekable file,
+// decompressing only the blocks that overlap. `*bytes_read` is short only at end of data.
+FileWriterError file_writer_read_range(const char* path, uint64_t offset, uint8_t* buf,
+                                       size_t size, size_t* bytes_read);
+
+// Checks every CRC32C block of a file written with crc_block_size == `block_size`, on `threads`
+// threads (0 = one per CPU; never more). On a mismatch returns InvalidData and the first bad
+// block's index; IoError if the file opens but cannot be read.
+FileWriterError file_writer_verify(const char* path, uint32_t block_size, uint32_t threads,
+                                   uint64_t* bad_block);
+
+// Fixed-size circular "flight recorder" file (unix): preallocated and mmap'd; writes wrap
+// around over the oldest data and survive a process crash without flushing.
+typedef struct FileWriterRecorder FileWriterRecorder;
+
+FileWriterError file_writer_recorder_new(const char* path, uint64_t capacity, FileWriterRecorder** handle);
+
+FileWriterError file_writer_recorder_write(FileWriterRecorder* handle, const uint8_t* data, size_t size);
+
+FileWriterError file_writer_recorder_sync(FileWriterRecorder* handle);
+
+FileWriterError file_writer_recorder_close(FileWriterRecorder* handle);
+
+// Writes the recorder's retained data, oldest first, to a regular file.
+FileWriterError file_writer_recorder_dump(const char* src_path, const char* dst_path);
+
 
 #ifdef __cplusplus
 } // extern "C"
@@ -0,0 +1,345 @@
+#ifndef FILE_WRITER_HPP
+#define FILE_WRITER_HPP
+
+// fw::Writer: a move-only owner of a FileWriterHandle that closes it on destruction.
+//
+//     fw::Writer writer;
+//     if (fw::Writer::open("out.log", FileWriterMode::Write, writer) != Success) { ... }
+//     writer.write("text");                         // length known: no strlen, no NUL scan
+//     writer.write_batch("id=", id_text, "\n");     // one call, descriptors on the stack
+//     writer.format<"id={} ms={}\n">(id, ms);       // see format.hpp
+//     std::format_to(writer.out(), "{} {}\n", a, b); // or fmt::format_to; see buffer_iterator
+//
+// Errors are returned as FileWriterError, as from the C API. Call close() to see the result of
+// closing; the destructor closes too but has to ignore it.
+//
+// fw::streambuf and fw::ofstream put std::ostream on top of a handle (see below).
+
+#include "file_writer.h"
+#include "format.hpp"
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ios>
+#include <iterator>
+#include <optional>
+#include <ostream>
+#include <ranges>
+#include <span>
+#include <streambuf>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace fw {
+
+// An output iterator for std::format_to, fmt::format_to, std::copy and the like. It is not
+// contiguous, so formatting libraries cannot write through a pointer: every char goes through
+// file_writer_put_char on its own, a store into the handle's buffer while there is room and a
+// call into the library when it is full. For long or hot output prefer format<> or
+// file_writer_reserve. Nothing needs committing afterwards. Errors cannot be thrown from an
+// assignment, so the first one is kept in the iterator: check error() on the iterator
+// format_to returns.
+class buffer_iterator {
+public:
+    using iterator_category = std::output_iterator_tag;
+    using value_type = void;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = void;
+
+    buffer_iterator() noexcept = default;
+    explicit buffer_iterator(FileWriterHandle* handle) noexcept : handle_(handle) {}
+
+    buffer_iterator& operator=(char c) {
+        FileWriterError err = file_writer_put_char(handle_, c);
+        if (err != Success && error_ == Success) {
+            error_ = err;
+        }
+        return *this;
+    }
+
+    buffer_iterator& operator*() noexcept { return *this; }
+    buffer_iterator& operator++() noexcept { return *this; }
+    buffer_iterator operator++(int) noexcept { return *this; }
+
+    FileWriterError error() const noexcept { return error_; }
+
+private:
+    FileWriterHandle* handle_ = nullptr;
+    FileWriterError error_ = Success;
+};
+
+// What std::format_to and fmt::format_to require of their output.
+static_assert(std::output_iterator<buffer_iterator, const char&>);
+
+class Writer {
+public:
+    Writer() noexcept = default;
+
+    // Takes ownership of `handle`.
+    explicit Writer(FileWriterHandle* handle) noexcept : handle_(handle) {}
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    Writer(Writer&& other) noexcept : handle_(other.release()) {}
+
+    Writer& operator=(Writer&& other) noexcept {
+        if (this != &other) {
+            close();
+            handle_ = other.release();
+        }
+        return *this;
+    }
+
+    ~Writer() { close(); }
+
+    // Opens `path` into `writer`, closing whatever it held before.
+    static FileWriterError open(const char* path, FileWriterMode mode, Writer& writer) {
+        return open(path, mode, nullptr, writer);
+    }
+
+    static FileWriterError open(const char* path, FileWriterMode mode,
+                                const FileWriterOptions* options, Writer& writer) {
+        FileWriterHandle* handle = nullptr;
+        FileWriterError err = file_writer_new_with_options(path, &handle, mode, options);
+        if (err == Success) {
+            writer = Writer(handle);
+        }
+        return err;
+    }
+
+    explicit operator bool() const noexcept { return handle_ != nullptr; }
+
+    FileWriterHandle* get() const noexcept { return handle_; }
+
+    // Gives up ownership without closing.
+    FileWriterHandle* release() noexcept { return std::exchange(handle_, nullptr); }
+
+    // Small writes are copied straight into the buffer (see file_writer_write_inline).
+    FileWriterError write(std::string_view text) {
+        return file_writer_write_inline(handle_, text.data(), text.size());
+    }
+
+    FileWriterError write(std::span<const std::byte> bytes) {
+        return file_writer_write_inline(handle_, bytes.data(), bytes.size());
+    }
+
+    FileWriterError put(char c) { return file_writer_put_char(handle_, c); }
+
+    // The bytes of `value` as they are in memory (host byte order, padding included). The size
+    // is a compile-time constant, so the inline copy is a fixed-size memcpy: one load and store
+    // for 1, 2, 4, 8 or 16 bytes.
+    template <typename T>
+        requires std::is_trivially_copyable_v<T>
+    FileWriterError write_pod(const T& value) {
+        return file_writer_write_inline(handle_, &value, sizeof(T));
+    }
+
+    // All elements of a contiguous range of trivially copyable values in one write.
+    template <std::ranges::contiguous_range R>
+        requires std::ranges::sized_range<R> &&
+                 std::is_trivially_copyable_v<std::ranges::range_value_t<R>>
+    FileWriterError write_range(R&& range) {
+        return file_writer_write_inline(
+            handle_, std::ranges::data(range),
+            std::ranges::size(range) * sizeof(std::ranges::range_value_t<R>));
+    }
+
+    // Writes all parts (text or bytes) in one call, without concatenating them first.
+    template <typename... Parts>
+    FileWriterError write_batch(const Parts&... parts) {
+        static_assert(sizeof...(Parts) > 0, "fw::Writer::write_batch: nothing to write");
+        const BufferDescriptor descriptors[] = {descriptor(parts)...};
+        return file_writer_write_batch(handle_, descriptors, sizeof...(Parts));
+    }
+
+    FileWriterError write_batch(std::span<const std::string_view> parts) {
+        constexpr std::size_t chunk = 32;
+        BufferDescriptor descriptors[chunk];
+        while (!parts.empty()) {
+            std::size_t count = parts.size() < chunk ? parts.size() : chunk;
+            for (std::size_t i = 0; i < count; ++i) {
+                descriptors[i] = descriptor(parts[i]);
+            }
+            FileWriterError err = file_writer_write_batch(handle_, descriptors, count);
+            if (err != Success) {
+                return err;
+            }
+            parts = parts.subspan(count);
+        }
+        return Success;
+    }
+
+    template <fixed_string Format, typename... Args>
+    FileWriterError format(const Args&... args) {
+        return fw::format<Format>(handle_, args...);
+    }
+
+    buffer_iterator out() noexcept { return buffer_iterator(handle_); }
+
+    FileWriterError flush() { return file_writer_flush(handle_); }
+
+    FileWriterError sync() { return file_writer_sync(handle_); }
+
+    // Closes the handle (also if closing fails); a closed or empty Writer returns Success.
+    FileWriterError close() {
+        if (handle_ == nullptr) {
+            return Success;
+        }
+        return file_writer_close(release());
+    }
+
+private:
+    static BufferDescriptor descriptor(std::string_view text) {
+        return {reinterpret_cast<const uint8_t*>(text.data()), text.size()};
+    }
+
+    static BufferDescriptor descriptor(std::span<const std::byte> bytes) {
+        return {reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size()};
+    }
+
+    FileWriterHandle* handle_ = nullptr;
+};
+
+// A std::streambuf whose put area is free space in the handle's own buffer (from
+// file_writer_reserve), so `stream << x` formats straight into it with no second buffer in
+// between. Output is handed to the handle (file_writer_commit) when the put area fills, on
+// commit(), and on destruction; pubsync() (std::flush, std::endl) also flushes the file.
+//
+// While the put area is live the handle must not be written to directly: call commit() first.
+// On segmented and timed handles, rollover happens only at those commit points.
+class streambuf : public std::streambuf {
+public:
+    explicit streambuf(FileWriterHandle* handle) noexcept : handle_(handle) {}
+
+    streambuf(const streambuf&) = delete;
+    streambuf& operator=(const streambuf&) = delete;
+
+    ~streambuf() override { commit(); }
+
+    // Hands what was written so far to the handle, without flushing the file.
+    FileWriterError commit() {
+        if (pbase() == nullptr) {
+            return Success;
+        }
+        std::size_t size = static_cast<std::size_t>(pptr() - pbase());
+        setp(nullptr, nullptr);
+        return file_writer_commit(handle_, size);
+    }
+
+protected:
+    int_type overflow(int_type ch) override {
+        if (commit() != Success || !reserve(1)) {
+            return traits_type::eof();
+        }
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        if (n > epptr() - pptr()) {
+            if (commit() != Success) {
+                return 0;
+            }
+            // Too large to be worth copying through the put area.
+            if (n >= large_write || !reserve(static_cast<std::size_t>(n))) {
+                return file_writer_write_string_n(handle_, s, static_cast<std::size_t>(n)) == Success
+                           ? n
+                           : 0;
+            }
+        }
+        std::memcpy(pptr(), s, static_cast<std::size_t>(n));
+        pbump(static_cast<int>(n));
+        return n;
+    }
+
+    int sync() override {
+        if (commit() != Success) {
+            return -1;
+        }
+        return file_writer_flush(handle_) == Success ? 0 : -1;
+    }
+
+private:
+    static constexpr std::streamsize large_write = 64 * 1024;
+
+    bool reserve(std::size_t min_size) {
+        uint8_t* data;
+        std::size_t available;
+        if (file_writer_reserve(handle_, min_size, &data, &available) != Success) {
+            return false;
+        }
+        // pbump takes an int.
+        if (available > static_cast<std::size_t>(INT32_MAX)) {
+            available = INT32_MAX;
+        }
+        char* begin = reinterpret_cast<char*>(data);
+        setp(begin, begin + available);
+        return true;
+    }
+
+    FileWriterHandle* handle_;
+};
+
+// Drop-in for std::ofstream output: opens (ios::app appends, otherwise truncates), writes
+// through fw::streambuf, and closes the handle on close() or destruction.
+class ofstream : public std::ostream {
+public:
+    ofstream() : std::ostream(&closed_) {}
+
+    explicit ofstream(const char* path, std::ios_base::openmode mode = std::ios_base::out)
+        : ofstream() {
+        open(path, mode);
+    }
+
+    ~ofstream() override { close(); }
+
+    void open(const char* path, std::ios_base::openmode mode = std::ios_base::out) {
+        close();
+        FileWriterMode fw_mode = (mode & std::ios_base::app) ? Append : Write;
+        if (Writer::open(path, fw_mode, writer_) != Success) {
+            setstate(std::ios_base::failbit);
+            return;
+        }
+        buf_.emplace(writer_.get());
+        rdbuf(&*buf_);
+        clear();
+    }
+
+    bool is_open() const noexcept { return static_cast<bool>(writer_); }
+
+    void close() {
+        if (!is_open()) {
+            return;
+        }
+        bool ok = buf_->commit() == Success;
+        rdbuf(&closed_);
+        buf_.reset();
+        ok = writer_.close() == Success && ok;
+        if (!ok) {
+            setstate(std::ios_base::failbit);
+        }
+    }
+
+    Writer& writer() noexcept { return writer_; }
+
+private:
+    // Installed while closed, like a closed std::filebuf: every write fails.
+    struct closed_streambuf : std::streambuf {};
+
+    closed_streambuf closed_;
+    Writer writer_;
+    // After writer_, so that it is destroyed (and commits) first.
+    std::optional<streambuf> buf_;
+};
+
+} // namespace fw
+
+#endif // FILE_WRITER_HPP
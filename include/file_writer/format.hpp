@@ -0,0 +1,176 @@
+#ifndef FILE_WRITER_FORMAT_HPP
+#define FILE_WRITER_FORMAT_HPP
+
+// fw::format<"ts={} id={} msg={}\n">(handle, ts, id, msg)
+//
+// The format string is parsed at compile time into literal segments and argument slots, so a
+// call does no parsing: it reserves space in the handle's buffer for the longest possible
+// output, copies each literal segment with a fixed-size memcpy, formats each argument in place
+// and commits. Placeholders are `{}` only; `{{` and `}}` stand for literal braces. A malformed
+// string or a wrong argument count fails to compile.
+//
+// Arguments: integers, bool ("true"/"false"), char, floating point (shortest round-trip form
+// where the standard library has floating-point std::to_chars), and anything convertible to
+// std::string_view.
+
+#include "file_writer.h"
+
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#if !defined(__cpp_nontype_template_args) || __cpp_nontype_template_args < 201911L
+#error "file_writer/format.hpp needs C++20 (string literals as template arguments)"
+#endif
+
+namespace fw {
+
+// A string literal usable as a template argument.
+template <std::size_t N>
+struct fixed_string {
+    char data[N] = {};
+
+    constexpr fixed_string(const char (&str)[N]) {
+        for (std::size_t i = 0; i < N; ++i) {
+            data[i] = str[i];
+        }
+    }
+
+    constexpr std::size_t size() const { return N - 1; }
+};
+
+namespace detail {
+
+struct segment {
+    std::size_t offset;
+    std::size_t size;
+};
+
+// The format string with escapes resolved, split around the placeholders:
+// segments[i] is the literal text before argument i (the last one is after all of them).
+template <std::size_t N>
+struct parsed_format {
+    std::array<char, N> text{};
+    std::array<segment, N> segments{};
+    std::size_t args = 0;
+    std::size_t literal_size = 0;
+};
+
+template <std::size_t N>
+constexpr parsed_format<N> parse(const fixed_string<N>& format) {
+    parsed_format<N> p;
+    std::size_t start = 0;
+    for (std::size_t i = 0; i < format.size(); ++i) {
+        char c = format.data[i];
+        if (c == '{' && i + 1 < format.size() && format.data[i + 1] == '}') {
+            p.segments[p.args] = {start, p.literal_size - start};
+            ++p.args;
+            start = p.literal_size;
+            ++i;
+            continue;
+        }
+        if (c == '{' || c == '}') {
+            if (i + 1 >= format.size() || format.data[i + 1] != c) {
+                throw "fw::format: unmatched brace in format string";
+            }
+            ++i;
+        }
+        p.text[p.literal_size++] = c;
+    }
+    p.segments[p.args] = {start, p.literal_size - start};
+    return p;
+}
+
+template <fixed_string Format>
+inline constexpr auto parsed = parse(Format);
+
+template <typename T>
+using arg_t = std::conditional_t<std::is_arithmetic_v<std::decay_t<T>>, std::decay_t<T>,
+                                 std::string_view>;
+
+// Longest output for each argument type.
+template <typename T>
+constexpr std::size_t max_size(T value) {
+    if constexpr (std::is_same_v<T, std::string_view>) {
+        return value.size();
+    } else if constexpr (std::is_same_v<T, bool>) {
+        return 5;
+    } else if constexpr (std::is_same_v<T, char>) {
+        return 1;
+    } else if constexpr (std::is_integral_v<T>) {
+        return std::numeric_limits<T>::digits10 + 2;
+    } else {
+        static_assert(std::is_floating_point_v<T>);
+        return 64;
+    }
+}
+
+template <typename T>
+inline char* write_arg(char* out, T value) {
+    if constexpr (std::is_same_v<T, std::string_view>) {
+        std::memcpy(out, value.data(), value.size());
+        return out + value.size();
+    } else if constexpr (std::is_same_v<T, bool>) {
+        std::memcpy(out, value ? "true" : "false", value ? 4 : 5);
+        return out + (value ? 4 : 5);
+    } else if constexpr (std::is_same_v<T, char>) {
+        *out = value;
+        return out + 1;
+    } else if constexpr (std::is_integral_v<T>) {
+        return std::to_chars(out, out + max_size(value), value).ptr;
+    } else {
+#if defined(__cpp_lib_to_chars)
+        return std::to_chars(out, out + max_size(value), value).ptr;
+#else
+        int len = std::snprintf(out, max_size(value), "%.17g", static_cast<double>(value));
+        return out + (len > 0 ? len : 0);
+#endif
+    }
+}
+
+template <const auto& P, std::size_t I>
+inline char* write_segment(char* out) {
+    constexpr segment seg = P.segments[I];
+    if constexpr (seg.size > 0) {
+        std::memcpy(out, P.text.data() + seg.offset, seg.size);
+    }
+    return out + seg.size;
+}
+
+template <const auto& P, std::size_t... I, typename... Args>
+inline FileWriterError format_args(FileWriterHandle* handle, std::index_sequence<I...>,
+                                   Args... args) {
+    // +1: snprintf, the floating-point fallback, writes a NUL.
+    const std::size_t max = P.literal_size + (max_size(args) + ... + 0) + 1;
+    uint8_t* data;
+    std::size_t available;
+    FileWriterError err = file_writer_reserve(handle, max, &data, &available);
+    if (err != Success) {
+        return err;
+    }
+
+    char* const start = reinterpret_cast<char*>(data);
+    char* out = write_segment<P, 0>(start);
+    ((out = write_segment<P, I + 1>(write_arg(out, args))), ...);
+    return file_writer_commit(handle, static_cast<std::size_t>(out - start));
+}
+
+} // namespace detail
+
+template <fixed_string Format, typename... Args>
+inline FileWriterError format(FileWriterHandle* handle, const Args&... args) {
+    static_assert(detail::parsed<Format>.args == sizeof...(Args),
+                  "fw::format: argument count does not match the {} in the format string");
+    return detail::format_args<detail::parsed<Format>>(handle, std::index_sequence_for<Args...>{},
+                                                       detail::arg_t<Args>(args)...);
+}
+
+} // namespace fw
+
+#endif // FILE_WRITER_FORMAT_HPP
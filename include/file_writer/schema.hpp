@@ -0,0 +1,235 @@
+#ifndef FILE_WRITER_SCHEMA_HPP
+#define FILE_WRITER_SCHEMA_HPP
+
+// Fixed-layout binary rows described at compile time:
+//
+//     namespace fs = fw::schema;
+//     using Tick = fs::row<fs::field<"ts", uint64_t>,
+//                          fs::field<"id", uint32_t, fs::big_endian>,
+//                          fs::pad<4>,
+//                          fs::field<"price", double>,
+//                          fs::text<"symbol", 8>>;
+//
+//     Tick::write_header(handle);                       // once, at the top of the file
+//     Tick::write(handle, ts, id, price, "AAPL");       // one call per row, no padding args
+//
+// Fields are packed in order with no implicit alignment; pad<N> adds N zero bytes. Numbers are
+// stored in the field's byte order, text<Name, N> as exactly N bytes (truncated or
+// zero-filled). Every offset and size is a compile-time constant, so a row is packed with
+// fixed-size stores straight into the handle's buffer, which the compiler can merge.
+//
+// The schema header is built at compile time (header_bytes) and is, all little-endian:
+//   "FWSC"  u16 version (1)  u16 field count  u32 row size
+//   per field: u8 type, u8 byte order (0 little, 1 big), u16 size, u32 offset,
+//              u8 name length, name bytes
+// with types 1-4 u8/u16/u32/u64, 5-8 i8/i16/i32/i64, 9 f32, 10 f64, 16 text, 32 padding.
+
+#include "file_writer.h"
+#include "format.hpp" // fw::fixed_string
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace fw::schema {
+
+enum byte_order : uint8_t { little_endian = 0, big_endian = 1 };
+
+template <fixed_string Name, typename T, byte_order Order = little_endian>
+struct field {
+    static_assert(std::is_arithmetic_v<T> && !std::is_same_v<T, bool> &&
+                      (sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8),
+                  "fw::schema::field: integers and floats of 1, 2, 4 or 8 bytes");
+
+    using value_type = T;
+    static constexpr auto name = Name;
+    static constexpr std::size_t size = sizeof(T);
+    static constexpr bool takes_value = true;
+    static constexpr uint8_t order = Order;
+    static constexpr uint8_t type = std::is_floating_point_v<T> ? (sizeof(T) == 4 ? 9 : 10)
+                                    : std::is_signed_v<T>
+                                        ? 5 + std::countr_zero(sizeof(T))
+                                        : 1 + std::countr_zero(sizeof(T));
+
+    static void store(char* out, T value) {
+        using U = std::conditional_t<
+            sizeof(T) == 1, uint8_t,
+            std::conditional_t<sizeof(T) == 2, uint16_t,
+                               std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>>>;
+        U bits = std::bit_cast<U>(value);
+        constexpr bool native = (Order == little_endian) == (std::endian::native == std::endian::little);
+        if constexpr (!native && sizeof(U) > 1) {
+            bits = byteswap(bits);
+        }
+        std::memcpy(out, &bits, sizeof(U));
+    }
+
+private:
+    template <typename U>
+    static constexpr U byteswap(U v) {
+        U r = 0;
+        for (std::size_t i = 0; i < sizeof(U); ++i) {
+            r = static_cast<U>((r << 8) | ((v >> (8 * i)) & 0xFF));
+        }
+        return r;
+    }
+};
+
+template <fixed_string Name, std::size_t N>
+struct text {
+    static_assert(N > 0 && N <= 0xFFFF, "fw::schema::text: 1 to 65535 bytes");
+
+    using value_type = std::string_view;
+    static constexpr auto name = Name;
+    static constexpr std::size_t size = N;
+    static constexpr bool takes_value = true;
+    static constexpr uint8_t order = little_endian;
+    static constexpr uint8_t type = 16;
+
+    static void store(char* out, std::string_view value) {
+        std::size_t len = value.size() < N ? value.size() : N;
+        std::memcpy(out, value.data(), len);
+        std::memset(out + len, 0, N - len);
+    }
+};
+
+template <std::size_t N>
+struct pad {
+    static constexpr fixed_string<1> name = "";
+    static constexpr std::size_t size = N;
+    static constexpr bool takes_value = false;
+    static constexpr uint8_t order = little_endian;
+    static constexpr uint8_t type = 32;
+
+    static void store(char* out) { std::memset(out, 0, N); }
+};
+
+namespace detail {
+
+template <typename... Fields>
+constexpr std::array<std::size_t, sizeof...(Fields)> offsets() {
+    std::array<std::size_t, sizeof...(Fields)> result{};
+    std::size_t offset = 0, i = 0;
+    ((result[i++] = offset, offset += Fields::size), ...);
+    return result;
+}
+
+// For each field, the index of its argument among those that take one.
+template <typename... Fields>
+constexpr std::array<std::size_t, sizeof...(Fields)> arg_indices() {
+    std::array<std::size_t, sizeof...(Fields)> result{};
+    std::size_t arg = 0, i = 0;
+    ((result[i++] = arg, arg += Fields::takes_value ? 1 : 0), ...);
+    return result;
+}
+
+template <typename T>
+constexpr void put_le(char* out, std::size_t& at, T value) {
+    for (std::size_t i = 0; i < sizeof(T); ++i) {
+        out[at++] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+} // namespace detail
+
+template <typename... Fields>
+struct row {
+    static constexpr std::size_t size = (Fields::size + ... + 0);
+    static constexpr std::size_t value_count = ((Fields::takes_value ? 1 : 0) + ... + 0);
+    static constexpr auto offsets = detail::offsets<Fields...>();
+
+    static_assert(size <= 0xFFFFFFFF, "fw::schema::row: row too large");
+
+    static_assert(sizeof...(Fields) <= 0xFFFF, "fw::schema::row: too many fields");
+    static_assert(((Fields::name.size() <= 0xFF) && ...), "fw::schema::row: name too long");
+
+    static constexpr std::size_t header_size = 12 + ((9 + Fields::name.size()) + ... + 0);
+
+    static constexpr std::array<char, header_size> header_bytes = [] {
+        std::array<char, header_size> h{};
+        std::size_t at = 0;
+        for (char c : {'F', 'W', 'S', 'C'}) {
+            h[at++] = c;
+        }
+        detail::put_le<uint16_t>(h.data(), at, 1);
+        detail::put_le<uint16_t>(h.data(), at, sizeof...(Fields));
+        detail::put_le<uint32_t>(h.data(), at, size);
+        std::size_t i = 0;
+        auto put_field = [&](uint8_t type, uint8_t order, std::size_t field_size,
+                             const char* name, std::size_t name_size) {
+            h[at++] = static_cast<char>(type);
+            h[at++] = static_cast<char>(order);
+            detail::put_le<uint16_t>(h.data(), at, static_cast<uint16_t>(field_size));
+            detail::put_le<uint32_t>(h.data(), at, static_cast<uint32_t>(offsets[i++]));
+            h[at++] = static_cast<char>(name_size);
+            for (std::size_t c = 0; c < name_size; ++c) {
+                h[at++] = name[c];
+            }
+        };
+        (put_field(Fields::type, Fields::order, Fields::size, Fields::name.data,
+                   Fields::name.size()),
+         ...);
+        return h;
+    }();
+
+    // Packs one row into `out`, which must have room for `size` bytes.
+    template <typename... Values>
+    static void pack(char* out, const Values&... values) {
+        static_assert(sizeof...(Values) == value_count,
+                      "fw::schema::row: one value per field, none for padding");
+        auto args = std::forward_as_tuple(values...);
+        pack_fields(out, args, std::index_sequence_for<Fields...>{});
+    }
+
+    // The schema header, once at the top of the file.
+    static FileWriterError write_header(FileWriterHandle* handle) {
+        return file_writer_write_raw(handle, reinterpret_cast<const uint8_t*>(header_bytes.data()),
+                                     header_size);
+    }
+
+    // Packs one row straight into the handle's buffer: in place through the cursor while it has
+    // room (see file_writer_write_inline), otherwise into a reservation.
+    template <typename... Values>
+    static FileWriterError write(FileWriterHandle* handle, const Values&... values) {
+        FileWriterCursor* cursor = reinterpret_cast<FileWriterCursor*>(handle);
+        if (handle != nullptr && cursor->pos <= cursor->cap && size <= cursor->cap - cursor->pos) {
+            pack(reinterpret_cast<char*>(cursor->data + cursor->pos), values...);
+            cursor->pos += size;
+            return Success;
+        }
+        uint8_t* data;
+        std::size_t available;
+        FileWriterError err = file_writer_reserve(handle, size, &data, &available);
+        if (err != Success) {
+            return err;
+        }
+        pack(reinterpret_cast<char*>(data), values...);
+        return file_writer_commit(handle, size);
+    }
+
+private:
+    template <typename Tuple, std::size_t... I>
+    static void pack_fields(char* out, const Tuple& args, std::index_sequence<I...>) {
+        constexpr auto arg = detail::arg_indices<Fields...>();
+        (pack_field<Fields, offsets[I], arg[I]>(out, args), ...);
+    }
+
+    template <typename Field, std::size_t Offset, std::size_t Arg, typename Tuple>
+    static void pack_field(char* out, const Tuple& args) {
+        if constexpr (Field::takes_value) {
+            Field::store(out + Offset, static_cast<typename Field::value_type>(std::get<Arg>(args)));
+        } else {
+            Field::store(out + Offset);
+        }
+    }
+};
+
+} // namespace fw::schema
+
+#endif // FILE_WRITER_SCHEMA_HPP
@@ -0,0 +1,347 @@
+//! Two process-wide worker threads for file housekeeping that must stay off
+//! the write path. One only opens and preallocates the next output files, so
+//! a handle's next file is never queued behind another handle's close (a
+//! whole compressor finish and flush) or a retention delete. The other
+//! flushes and closes files that writers have moved away from and deletes
+//! old files under a retention rule. Jobs can be scheduled for a later
+//! instant, which is how time-based rotation prepares the next file just
+//! ahead of its boundary.
+
+use crate::buffer::OutputBuffer;
+use crate::retention::{self, Retention};
+use crate::sink::Sink;
+use std::cmp::Reverse;
+use std::collections::{BinaryHeap, VecDeque};
+use std::fs::{self, File, OpenOptions};
+use std::io;
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicBool, Ordering};
+#[cfg(test)]
+use std::sync::mpsc::SyncSender;
+use std::sync::mpsc::{channel, Receiver, RecvTimeoutError, Sender};
+use std::sync::{Arc, Condvar, Mutex, OnceLock};
+use std::thread;
+use std::time::Instant;
+
+/// Hands a prepared writer from the worker to the thread that will write to
+/// it, and carries back errors from closes done on the writer's behalf.
+#[derive(Default)]
+pub(crate) struct Handover {
+    state: Mutex<HandoverState>,
+    /// Signalled whenever a job for this handover finishes.
+    done: Condvar,
+    close_failed: AtomicBool,
+    pub(crate) retention: Mutex<Option<Retention>>,
+}
+
+#[derive(Default)]
+struct HandoverState {
+    next: Option<io::Result<OutputBuffer<Sink>>>,
+    /// Opens that have started and closes that have been submitted for this
+    /// handover, and not finished yet.
+    in_flight: usize,
+    cancelled: bool,
+}
+
+impl Handover {
+    /// Counts a job as in flight. Opens are dropped instead once the
+    /// handover is shut down; closes always run.
+    fn begin(&self, cancellable: bool) -> bool {
+        let mut state = self.state.lock().unwrap();
+        if cancellable && state.cancelled {
+            return false;
+        }
+        state.in_flight += 1;
+        true
+    }
+
+    fn end(&self, next: Option<io::Result<OutputBuffer<Sink>>>) {
+        let mut state = self.state.lock().unwrap();
+        if next.is_some() {
+            state.next = next;
+        }
+        state.in_flight -= 1;
+        self.done.notify_all();
+    }
+
+    /// Takes the prepared writer if the worker has finished opening it.
+    /// Never waits.
+    pub(crate) fn try_take(&self) -> Option<io::Result<OutputBuffer<Sink>>> {
+        self.state.lock().unwrap().next.take()
+    }
+
+    /// Stops jobs that have not started yet from touching this handover,
+    /// waits for its own jobs in flight (not for other handovers'), and
+    /// returns whatever writer was left prepared.
+    pub(crate) fn shut_down(&self) -> Option<io::Result<OutputBuffer<Sink>>> {
+        let mut state = self.state.lock().unwrap();
+        state.cancelled = true;
+        while state.in_flight > 0 {
+            state = self.done.wait(state).unwrap();
+        }
+        state.next.take()
+    }
+
+    /// Returns true if a background close has failed since the last call.
+    pub(crate) fn take_close_failure(&self) -> bool {
+        self.close_failed.swap(false, Ordering::AcqRel)
+    }
+
+    /// Waits up to `timeout` for the next writer to be prepared.
+    #[cfg(test)]
+    pub(crate) fn wait_prepared(&self, timeout: std::time::Duration) -> bool {
+        let state = self.state.lock().unwrap();
+        let (state, _) = self
+            .done
+            .wait_timeout_while(state, timeout, |s| s.next.is_none())
+            .unwrap();
+        state.next.is_some()
+    }
+}
+
+pub(crate) enum Job {
+    /// Create or open `path` (and its parent directories), reserve
+    /// `preallocate` bytes for it and pass the buffered writer to `handover`.
+    Open {
+        path: PathBuf,
+        append: bool,
+        preallocate: u64,
+        capacity: usize,
+        handover: Arc<Handover>,
+    },
+    /// Flush and close a writer nobody writes to anymore, then apply the
+    /// handover's retention rule now that `path` is complete.
+    Close {
+        writer: OutputBuffer<Sink>,
+        path: PathBuf,
+        handover: Arc<Handover>,
+    },
+    /// Delete files oldest first, at most `bytes_per_sec` (0 = unlimited).
+    Remove {
+        files: VecDeque<(PathBuf, u64)>,
+        bytes_per_sec: u64,
+    },
+    /// Holds up one worker until `done` is received from.
+    #[cfg(test)]
+    Barrier {
+        open_worker: bool,
+        done: SyncSender<()>,
+    },
+}
+
+/// A job, with the instant it should run at if it is not to run right away.
+type Message = (Option<Instant>, Job);
+
+struct Scheduled {
+    at: Instant,
+    seq: u64,
+    job: Job,
+}
+
+impl PartialEq for Scheduled {
+    fn eq(&self, other: &Self) -> bool {
+        (self.at, self.seq) == (other.at, other.seq)
+    }
+}
+
+impl Eq for Scheduled {}
+
+impl PartialOrd for Scheduled {
+    fn partial_cmp(&self, other: &Self) -> Option<std::cmp::Ordering> {
+        Some(self.cmp(other))
+    }
+}
+
+impl Ord for Scheduled {
+    fn cmp(&self, other: &Self) -> std::cmp::Ordering {
+        (self.at, self.seq).cmp(&(other.at, other.seq))
+    }
+}
+
+pub(crate) fn submit(job: Job) {
+    send(None, job);
+}
+
+/// Runs `job` on its worker no earlier than `at`.
+pub(crate) fn submit_at(at: Instant, job: Job) {
+    send(Some(at), job);
+}
+
+fn send(at: Option<Instant>, job: Job) {
+    static OPENER: OnceLock<Mutex<Sender<Message>>> = OnceLock::new();
+    static HOUSEKEEPER: OnceLock<Mutex<Sender<Message>>> = OnceLock::new();
+
+    let (lane, name) = match job {
+        Job::Open { .. } => (&OPENER, "file-writer-open"),
+        #[cfg(test)]
+        Job::Barrier {
+            open_worker: true, ..
+        } => (&OPENER, "file-writer-open"),
+        _ => (&HOUSEKEEPER, "file-writer-bg"),
+    };
+    if let Job::Close { handover, .. } = &job {
+        handover.begin(false);
+    }
+
+    let sender = lane.get_or_init(|| {
+        let (tx, rx) = channel();
+        // If the thread cannot be spawned `rx` is dropped with the closure,
+        // every send fails and jobs run inline on the caller instead.
+        let _ = thread::Builder::new()
+            .name(name.into())
+            .spawn(move || worker(rx));
+        Mutex::new(tx)
+    });
+
+    let sent = sender.lock().unwrap().send((at, job));
+    if let Err(unsent) = sent {
+        run(unsent.0 .1);
+    }
+}
+
+fn worker(rx: Receiver<Message>) {
+    let mut delayed: BinaryHeap<Reverse<Scheduled>> = BinaryHeap::new();
+    let mut seq = 0u64;
+
+    loop {
+        while let Some(Reverse(next)) = delayed.peek() {
+            if next.at > Instant::now() {
+                break;
+            }
+            let Reverse(next) = delayed.pop().unwrap();
+            run(next.job);
+        }
+
+        let received = match delayed.peek() {
+            Some(Reverse(next)) => {
+                match rx.recv_timeout(next.at.saturating_duration_since(Instant::now())) {
+                    Ok(msg) => msg,
+                    Err(RecvTimeoutError::Timeout) => continue,
+                    Err(RecvTimeoutError::Disconnected) => return,
+                }
+            }
+            None => match rx.recv() {
+                Ok(msg) => msg,
+                Err(_) => return,
+            },
+        };
+
+        match received {
+            (Some(at), job) if at > Instant::now() => {
+                seq += 1;
+                delayed.push(Reverse(Scheduled { at, seq, job }));
+            }
+            (_, job) => run(job),
+        }
+    }
+}
+
+fn run(job: Job) {
+    match job {
+        Job::Open {
+            path,
+            append,
+            preallocate,
+            capacity,
+            handover,
+        } => {
+            if !handover.begin(true) {
+                return;
+            }
+            let result = open_preallocated(&path, append, preallocate)
+                .map(|file| OutputBuffer::with_capacity(capacity, Sink::new(file)));
+            handover.end(Some(result));
+        }
+        Job::Close {
+            writer,
+            path,
+            handover,
+        } => {
+            match writer.into_inner().and_then(Sink::finish) {
+                Ok(file) => {
+                    let size = file.metadata().map_or(0, |m| m.len());
+                    apply_retention(&handover, path, size);
+                }
+                Err(_) => handover.close_failed.store(true, Ordering::Release),
+            }
+            handover.end(None);
+        }
+        Job::Remove {
+            mut files,
+            bytes_per_sec,
+        } => {
+            // Rate-limited deletion reschedules itself rather than sleeping,
+            // so it never holds up opens and closes for other writers.
+            if let Some(wait) = retention::delete_step(&mut files, bytes_per_sec) {
+                submit_at(
+                    Instant::now() + wait,
+                    Job::Remove {
+                        files,
+                        bytes_per_sec,
+                    },
+                );
+            }
+        }
+        #[cfg(test)]
+        Job::Barrier { done, .. } => {
+            let _ = done.send(());
+        }
+    }
+}
+
+/// Counts the closed file `path` towards the handover's retention rule, if
+/// it has one, and deletes what the rule no longer keeps.
+fn apply_retention(handover: &Handover, path: PathBuf, size: u64) {
+    let mut retention = handover.retention.lock().unwrap();
+    if let Some(retention) = retention.as_mut() {
+        retention.push(path, size);
+        let files = retention.expired();
+        if !files.is_empty() {
+            run(Job::Remove {
+                files,
+                bytes_per_sec: retention.bytes_per_sec,
+            });
+        }
+    }
+}
+
+pub(crate) fn open_preallocated(path: &Path, append: bool, preallocate: u64) -> io::Result<File> {
+    if let Some(parent) = path.parent() {
+        if !parent.as_os_str().is_empty() {
+            fs::create_dir_all(parent)?;
+        }
+    }
+    let file = if append {
+        OpenOptions::new().create(true).append(true).open(path)?
+    } else {
+        OpenOptions::new()
+            .create(true)
+            .write(true)
+            .truncate(true)
+            .open(path)?
+    };
+    preallocate_blocks(&file, preallocate);
+    Ok(file)
+}
+
+/// Reserves disk blocks without changing the file size, so a file that is
+/// closed early does not end in a run of zeros. Best effort: filesystems
+/// without `fallocate` simply allocate on write.
+#[cfg(target_os = "linux")]
+fn preallocate_blocks(file: &File, len: u64) {
+    use std::os::fd::AsRawFd;
+
+    if len > 0 {
+        unsafe {
+            libc::fallocate(
+                file.as_raw_fd(),
+                libc::FALLOC_FL_KEEP_SIZE,
+                0,
+                len.min(i64::MAX as u64) as libc::off_t,
+            );
+        }
+    }
+}
+
+#[cfg(not(target_os = "linux"))]
+fn preallocate_blocks(_file: &File, _len: u64) {}
@@ -0,0 +1,300 @@
+//! The write buffer in front of a handle's `Sink`. It works like
+//! `std::io::BufWriter`, and also lets callers write into its free space in
+//! place: through `reserve` then `commit`, or, from C, through the
+//! `FileWriterCursor` at its start, which the header's inline writers fill
+//! directly without calling into the library.
+
+use std::io::{self, Write};
+use std::mem::ManuallyDrop;
+use std::ptr;
+use std::slice;
+
+/// The part of a handle's buffer that C code writes to directly: bytes
+/// `[0, pos)` at `data` are buffered output, and a write of `n` bytes may be
+/// copied in place while `pos <= cap` and `n <= cap - pos`. `cap` is 0 while
+/// writes must go through the library (segmented and timed handles, which
+/// count every write, and handles that failed), and `pos` may then be larger.
+#[repr(C)]
+#[derive(Debug)]
+pub(crate) struct FileWriterCursor {
+    pub(crate) data: *mut u8,
+    pub(crate) pos: usize,
+    pub(crate) cap: usize,
+}
+
+#[repr(C)]
+pub(crate) struct OutputBuffer<W: Write> {
+    /// Must stay the first field: C finds it at the start of the handle.
+    cursor: FileWriterCursor,
+    /// Size of the allocation at `cursor.data`, which this owns. It is only
+    /// accessed through raw pointers, since C code writes to it too.
+    capacity: usize,
+    /// The capacity asked for. `capacity` is larger only while a reservation
+    /// that did not fit is outstanding; committing it shrinks the buffer back.
+    base_capacity: usize,
+    inline_writes: bool,
+    /// Bytes handed to `inner` so far.
+    written: u64,
+    inner: W,
+}
+
+// The buffer is owned exclusively, like a `Box<[u8]>`; the raw pointer is
+// only there so that C code may write through it on the owning thread.
+unsafe impl<W: Write + Send> Send for OutputBuffer<W> {}
+
+impl<W: Write> OutputBuffer<W> {
+    /// A buffer with inline writes off; see `set_inline_writes`.
+    pub(crate) fn with_capacity(capacity: usize, inner: W) -> Self {
+        OutputBuffer {
+            cursor: FileWriterCursor {
+                data: alloc(capacity),
+                pos: 0,
+                cap: 0,
+            },
+            capacity,
+            base_capacity: capacity,
+            inline_writes: false,
+            written: 0,
+            inner,
+        }
+    }
+
+    /// Lets C code copy writes straight into the buffer (or stops it).
+    pub(crate) fn set_inline_writes(&mut self, enabled: bool) {
+        self.inline_writes = enabled;
+        self.cursor.cap = if enabled { self.capacity } else { 0 };
+    }
+
+    pub(crate) fn get_ref(&self) -> &W {
+        &self.inner
+    }
+
+    /// Bytes written through this buffer so far, buffered ones included.
+    #[inline(always)]
+    pub(crate) fn position(&self) -> u64 {
+        self.written + self.cursor.pos as u64
+    }
+
+    /// Writes out the buffer, then `data` straight to the underlying writer
+    /// whatever its size.
+    pub(crate) fn write_unbuffered(&mut self, data: &[u8]) -> io::Result<()> {
+        self.flush_buf()?;
+        self.inner.write_all(data)?;
+        self.written += data.len() as u64;
+        Ok(())
+    }
+
+    /// Writes out the buffer and returns the underlying writer (without
+    /// flushing it).
+    pub(crate) fn into_inner(mut self) -> io::Result<W> {
+        self.flush_buf()?;
+        let mut this = ManuallyDrop::new(self);
+        this.free();
+        // `inner` is moved out exactly once and `this` is never dropped.
+        Ok(unsafe { ptr::read(&this.inner) })
+    }
+
+    /// Writes out the buffer and replaces it with one of `capacity` bytes.
+    pub(crate) fn set_capacity(&mut self, capacity: usize) -> io::Result<()> {
+        self.resize(capacity)?;
+        self.base_capacity = capacity;
+        Ok(())
+    }
+
+    fn resize(&mut self, capacity: usize) -> io::Result<()> {
+        self.flush_buf()?;
+        self.free();
+        self.cursor.data = alloc(capacity);
+        self.capacity = capacity;
+        self.set_inline_writes(self.inline_writes);
+        Ok(())
+    }
+
+    /// Free space for at least `min_size` bytes, written out (or, if the
+    /// buffer is smaller than that, grown until the commit) first if needed.
+    /// Bytes written there become part of the output only once `commit`ted.
+    #[inline]
+    pub(crate) fn reserve(&mut self, min_size: usize) -> io::Result<&mut [u8]> {
+        if self.spare() < min_size {
+            self.make_room(min_size)?;
+        }
+        let spare = self.spare();
+        Ok(unsafe { slice::from_raw_parts_mut(self.cursor.data.add(self.cursor.pos), spare) })
+    }
+
+    /// Adds the first `size` bytes of the space `reserve` returned. If the
+    /// buffer had to grow for them, they are written out and the buffer
+    /// shrinks back; an error then comes from that write.
+    #[inline]
+    pub(crate) fn commit(&mut self, size: usize) -> io::Result<()> {
+        self.reserved(size)?;
+        self.cursor.pos += size;
+        if self.capacity > self.base_capacity {
+            return self.resize(self.base_capacity);
+        }
+        Ok(())
+    }
+
+    /// The first `size` bytes of the space `reserve` returned, not committed.
+    pub(crate) fn reserved(&self, size: usize) -> io::Result<&[u8]> {
+        if size > self.spare() {
+            return Err(io::ErrorKind::InvalidInput.into());
+        }
+        Ok(unsafe { slice::from_raw_parts(self.cursor.data.add(self.cursor.pos), size) })
+    }
+
+    #[inline(always)]
+    fn spare(&self) -> usize {
+        self.capacity - self.cursor.pos
+    }
+
+    #[cold]
+    fn make_room(&mut self, min_size: usize) -> io::Result<()> {
+        if self.capacity < min_size {
+            return self.resize(min_size);
+        }
+        self.flush_buf()
+    }
+
+    /// Writes the buffered bytes to `inner`. On error, whatever was not
+    /// written stays buffered.
+    fn flush_buf(&mut self) -> io::Result<()> {
+        let len = self.cursor.pos;
+        let buf = unsafe { slice::from_raw_parts_mut(self.cursor.data, len) };
+        let mut written = 0;
+        let result = loop {
+            if written == len {
+                break Ok(());
+            }
+            match self.inner.write(&buf[written..]) {
+                Ok(0) => break Err(io::ErrorKind::WriteZero.into()),
+                Ok(n) => written += n,
+                Err(e) if e.kind() == io::ErrorKind::Interrupted => {}
+                Err(e) => break Err(e),
+            }
+        };
+        buf.copy_within(written.., 0);
+        self.cursor.pos = len - written;
+        self.written += written as u64;
+        result
+    }
+
+    #[cold]
+    fn write_all_cold(&mut self, data: &[u8]) -> io::Result<()> {
+        if data.len() >= self.capacity {
+            return self.write_unbuffered(data);
+        }
+        self.flush_buf()?;
+        unsafe { ptr::copy_nonoverlapping(data.as_ptr(), self.cursor.data, data.len()) };
+        self.cursor.pos = data.len();
+        Ok(())
+    }
+
+    fn free(&mut self) {
+        let buf = ptr::slice_from_raw_parts_mut(self.cursor.data, self.capacity);
+        drop(unsafe { Box::from_raw(buf) });
+        self.cursor.data = ptr::null_mut();
+        self.cursor.pos = 0;
+        self.capacity = 0;
+        self.cursor.cap = 0;
+    }
+}
+
+fn alloc(capacity: usize) -> *mut u8 {
+    Box::into_raw(vec![0u8; capacity].into_boxed_slice()).cast()
+}
+
+impl<W: Write> Write for OutputBuffer<W> {
+    #[inline]
+    fn write(&mut self, data: &[u8]) -> io::Result<usize> {
+        self.write_all(data)?;
+        Ok(data.len())
+    }
+
+    #[inline]
+    fn write_all(&mut self, data: &[u8]) -> io::Result<()> {
+        if data.len() <= self.spare() {
+            unsafe {
+                let end = self.cursor.data.add(self.cursor.pos);
+                ptr::copy_nonoverlapping(data.as_ptr(), end, data.len());
+            }
+            self.cursor.pos += data.len();
+            return Ok(());
+        }
+        self.write_all_cold(data)
+    }
+
+    fn flush(&mut self) -> io::Result<()> {
+        self.flush_buf()?;
+        self.inner.flush()
+    }
+}
+
+impl<W: Write> Drop for OutputBuffer<W> {
+    fn drop(&mut self) {
+        // Like `BufWriter`: best effort; `into_inner` reports errors.
+        let _ = self.flush_buf();
+        self.free();
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_reserve_commit_and_growth() {
+        let mut out = OutputBuffer::with_capacity(8, Vec::new());
+        out.write_all(b"abc").unwrap();
+
+        let space = out.reserve(4).unwrap();
+        assert_eq!(space.len(), 5);
+        space[..2].copy_from_slice(b"de");
+        out.commit(2).unwrap();
+        assert!(out.get_ref().is_empty());
+
+        // Needs more than is free: the buffer is written out first.
+        out.reserve(4).unwrap()[..4].copy_from_slice(b"fghi");
+        out.commit(4).unwrap();
+        assert_eq!(out.get_ref(), b"abcde");
+
+        // Needs more than the whole buffer: it grows until the commit, which
+        // writes the reservation out and shrinks it back.
+        let space = out.reserve(20).unwrap();
+        assert!(space.len() >= 20);
+        space[..20].copy_from_slice(&[b'x'; 20]);
+        out.commit(20).unwrap();
+        assert_eq!(out.get_ref().len(), 29);
+        assert_eq!(out.capacity, 8);
+        assert!(out.commit(usize::MAX).is_err());
+
+        out.write_all(&[b'y'; 30]).unwrap();
+        let inner = out.into_inner().unwrap();
+        assert_eq!(
+            inner,
+            [&b"abcdefghi"[..], &[b'x'; 20], &[b'y'; 30]].concat()
+        );
+    }
+
+    #[test]
+    fn test_cursor_tracks_the_buffer() {
+        let mut out = OutputBuffer::with_capacity(16, Vec::new());
+        assert_eq!(out.cursor.cap, 0);
+        out.set_inline_writes(true);
+        assert_eq!(out.cursor.cap, 16);
+
+        // What C does: copy in place and advance `pos`.
+        unsafe { ptr::copy_nonoverlapping(b"inline ".as_ptr(), out.cursor.data, 7) };
+        out.cursor.pos += 7;
+        out.write_all(b"rust").unwrap();
+
+        assert_eq!(out.position(), 11);
+
+        out.set_capacity(64).unwrap();
+        assert_eq!(out.cursor.cap, 64);
+        assert_eq!(out.cursor.pos, 0);
+        assert_eq!(out.get_ref(), b"inline rust");
+        out.write_all(&[b'z'; 100]).unwrap();
+        assert_eq!(out.position(), 111);
+    }
+}
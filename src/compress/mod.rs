@@ -0,0 +1,75 @@
+//! Compression codecs that can sit between a handle's buffer and its file.
+
+#[cfg(feature = "lz4")]
+mod lz4_frame;
+#[cfg(feature = "zstd")]
+mod parallel;
+#[cfg(feature = "zstd")]
+mod seekable;
+#[cfg(feature = "zstd")]
+mod zstd_stream;
+
+#[cfg(feature = "zstd")]
+pub use seekable::read_seekable_range;
+
+use crate::{FileWriterCompression, FileWriterError, FileWriterOptions};
+use std::io;
+
+pub(crate) trait Codec: Send {
+    /// Compresses `input`, appending whatever output is ready to `out`.
+    fn compress(&mut self, input: &[u8], out: &mut Vec<u8>) -> io::Result<()>;
+
+    /// Completes the current frame, if any input went into it, so that
+    /// everything emitted so far can be decoded on its own.
+    fn end_frame(&mut self, out: &mut Vec<u8>) -> io::Result<()>;
+
+    /// Ends the output for good; called once, when the file is closed.
+    fn finish(&mut self, out: &mut Vec<u8>) -> io::Result<()> {
+        self.end_frame(out)
+    }
+}
+
+/// Builds the `compression` codec with the rest of `options`, or `None` for
+/// uncompressed output.
+pub(crate) fn new_codec(
+    compression: FileWriterCompression,
+    options: &FileWriterOptions,
+) -> Result<Option<Box<dyn Codec>>, FileWriterError> {
+    #[cfg(not(feature = "zstd"))]
+    let _ = options;
+    match compression {
+        FileWriterCompression::None => Ok(None),
+        #[cfg(feature = "zstd")]
+        FileWriterCompression::Zstd => {
+            let level = options.compression_level;
+            let codec: Box<dyn Codec> = match options.compression_threads {
+                0 | 1 => Box::new(
+                    zstd_stream::ZstdStream::new(level)
+                        .map_err(|_| FileWriterError::InvalidData)?,
+                ),
+                threads => Box::new(
+                    parallel::ParallelZstd::new(level, threads as usize, false)
+                        .map_err(|_| FileWriterError::InvalidData)?,
+                ),
+            };
+            Ok(Some(codec))
+        }
+        // Seekable output is made of bounded blocks, so it always goes
+        // through the block compressor, with at least one worker thread.
+        #[cfg(feature = "zstd")]
+        FileWriterCompression::ZstdSeekable => {
+            let threads = options.compression_threads.max(1) as usize;
+            parallel::ParallelZstd::new(options.compression_level, threads, true)
+                .map(|c| Some(Box::new(c) as Box<dyn Codec>))
+                .map_err(|_| FileWriterError::InvalidData)
+        }
+        #[cfg(not(feature = "zstd"))]
+        FileWriterCompression::Zstd | FileWriterCompression::ZstdSeekable => {
+            Err(FileWriterError::UnsupportedOption)
+        }
+        #[cfg(feature = "lz4")]
+        FileWriterCompression::Lz4 => Ok(Some(Box::new(lz4_frame::Lz4Frame::new()))),
+        #[cfg(not(feature = "lz4"))]
+        FileWriterCompression::Lz4 => Err(FileWriterError::UnsupportedOption),
+    }
+}
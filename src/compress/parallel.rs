@@ -0,0 +1,239 @@
+//! zstd spread over a pool of threads: input is cut into fixed-size blocks,
+//! each block is compressed as an independent frame by whichever worker is
+//! free, and the frames are emitted in input order. The concatenation is an
+//! ordinary multi-frame zstd stream.
+
+use super::seekable::SeekTable;
+use super::Codec;
+use std::collections::VecDeque;
+use std::io;
+use std::mem;
+use std::sync::mpsc::{channel, sync_channel, Receiver, RecvError, Sender, SyncSender};
+use std::sync::{Arc, Mutex};
+use std::thread::{self, JoinHandle};
+use zstd::bulk::Compressor;
+use zstd::zstd_safe::compress_bound;
+
+/// Input bytes per independently compressed block.
+pub(crate) const BLOCK_SIZE: usize = 1024 * 1024;
+
+/// A block to compress, the buffer to compress it into, and where to send
+/// both back once done.
+struct Task {
+    input: Vec<u8>,
+    output: Vec<u8>,
+    done: SyncSender<Done>,
+}
+
+struct Done {
+    result: io::Result<()>,
+    input: Vec<u8>,
+    output: Vec<u8>,
+}
+
+pub(crate) struct ParallelZstd {
+    tasks: Option<Sender<Task>>,
+    workers: Vec<JoinHandle<()>>,
+    /// The block being filled.
+    block: Vec<u8>,
+    /// Blocks handed to workers, oldest first; their output is emitted in
+    /// this order.
+    in_flight: VecDeque<Receiver<Done>>,
+    /// Blocks allowed in flight before `compress` waits for the oldest.
+    max_in_flight: usize,
+    /// Recycled block and output buffers.
+    spare: Vec<(Vec<u8>, Vec<u8>)>,
+    /// Frame sizes, for output that ends in a seek table.
+    seek_table: Option<SeekTable>,
+}
+
+impl ParallelZstd {
+    /// With `seekable`, `finish` appends a seek table indexing the frames.
+    /// `threads` is capped at `max_threads()`.
+    pub(crate) fn new(level: i32, threads: usize, seekable: bool) -> io::Result<Self> {
+        let threads = threads.clamp(1, max_threads());
+        let (tx, rx) = channel::<Task>();
+        let rx = Arc::new(Mutex::new(rx));
+
+        let mut workers = Vec::with_capacity(threads);
+        for i in 0..threads {
+            // Created here so a bad level is reported by the constructor.
+            let compressor = Compressor::new(level)?;
+            let rx = rx.clone();
+            let worker = thread::Builder::new()
+                .name(format!("file-writer-zstd-{i}"))
+                .spawn(move || compress_blocks(compressor, &rx))?;
+            workers.push(worker);
+        }
+
+        Ok(ParallelZstd {
+            tasks: Some(tx),
+            workers,
+            block: Vec::with_capacity(BLOCK_SIZE),
+            in_flight: VecDeque::new(),
+            max_in_flight: 2 * threads,
+            spare: Vec::new(),
+            seek_table: seekable.then(SeekTable::default),
+        })
+    }
+
+    fn submit_block(&mut self, out: &mut Vec<u8>) -> io::Result<()> {
+        if self.in_flight.len() >= self.max_in_flight {
+            self.collect_oldest(out)?;
+        }
+
+        let (next_block, output) = self
+            .spare
+            .pop()
+            .unwrap_or_else(|| (Vec::with_capacity(BLOCK_SIZE), Vec::new()));
+        let input = mem::replace(&mut self.block, next_block);
+        let (done, receiver) = sync_channel(1);
+        let task = Task {
+            input,
+            output,
+            done,
+        };
+        let sent = self.tasks.as_ref().map(|tx| tx.send(task));
+        if !matches!(sent, Some(Ok(()))) {
+            return Err(io::Error::other("compression workers stopped"));
+        }
+        self.in_flight.push_back(receiver);
+        Ok(())
+    }
+
+    /// Waits for the oldest block in flight and appends its frame to `out`.
+    fn collect_oldest(&mut self, out: &mut Vec<u8>) -> io::Result<()> {
+        let done = match self.in_flight.pop_front() {
+            Some(receiver) => receiver.recv(),
+            None => return Ok(()),
+        };
+        self.emit(done, out)
+    }
+
+    /// Appends the frames of blocks that are already compressed, in order,
+    /// without waiting for the rest.
+    fn collect_ready(&mut self, out: &mut Vec<u8>) -> io::Result<()> {
+        while let Some(Ok(done)) = self.in_flight.front().map(Receiver::try_recv) {
+            self.in_flight.pop_front();
+            self.emit(Ok(done), out)?;
+        }
+        Ok(())
+    }
+
+    fn emit(&mut self, done: Result<Done, RecvError>, out: &mut Vec<u8>) -> io::Result<()> {
+        let done = done.map_err(|_| io::Error::other("compression worker died"))?;
+        done.result?;
+        out.extend_from_slice(&done.output);
+        if let Some(ref mut table) = self.seek_table {
+            table.push(done.output.len(), done.input.len());
+        }
+
+        let mut input = done.input;
+        input.clear();
+        self.spare.push((input, done.output));
+        Ok(())
+    }
+}
+
+impl Codec for ParallelZstd {
+    fn compress(&mut self, mut input: &[u8], out: &mut Vec<u8>) -> io::Result<()> {
+        while !input.is_empty() {
+            let take = input.len().min(BLOCK_SIZE - self.block.len());
+            self.block.extend_from_slice(&input[..take]);
+            input = &input[take..];
+            if self.block.len() == BLOCK_SIZE {
+                self.submit_block(out)?;
+            }
+        }
+        self.collect_ready(out)
+    }
+
+    fn end_frame(&mut self, out: &mut Vec<u8>) -> io::Result<()> {
+        if !self.block.is_empty() {
+            self.submit_block(out)?;
+        }
+        while !self.in_flight.is_empty() {
+            self.collect_oldest(out)?;
+        }
+        Ok(())
+    }
+
+    fn finish(&mut self, out: &mut Vec<u8>) -> io::Result<()> {
+        self.end_frame(out)?;
+        if let Some(ref table) = self.seek_table {
+            table.write_to(out);
+        }
+        Ok(())
+    }
+}
+
+impl Drop for ParallelZstd {
+    fn drop(&mut self) {
+        // Closing the queue stops the workers once they are idle.
+        self.tasks = None;
+        for worker in self.workers.drain(..) {
+            let _ = worker.join();
+        }
+    }
+}
+
+/// More workers than CPUs only add threads and buffered blocks (two per
+/// worker), so a bad option cannot spawn thousands of either.
+pub(crate) fn max_threads() -> usize {
+    thread::available_parallelism().map_or(1, |n| n.get())
+}
+
+fn compress_blocks(mut compressor: Compressor<'static>, tasks: &Mutex<Receiver<Task>>) {
+    loop {
+        let task = match tasks.lock().unwrap().recv() {
+            Ok(t) => t,
+            Err(_) => return,
+        };
+        let Task {
+            input,
+            mut output,
+            done,
+        } = task;
+        output.clear();
+        output.reserve(compress_bound(input.len()));
+        let result = compressor.compress_to_buffer(&input[..], &mut output);
+        let _ = done.send(Done {
+            result: result.map(|_| ()),
+            input,
+            output,
+        });
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_threads_are_capped() {
+        let codec = ParallelZstd::new(1, u32::MAX as usize, false).unwrap();
+        assert_eq!(codec.workers.len(), max_threads());
+        assert_eq!(codec.max_in_flight, 2 * max_threads());
+    }
+
+    #[test]
+    fn test_blocks_come_out_in_order() {
+        // Distinct content per block, so any reordering shows up.
+        let input: Vec<u8> = (0..5 * BLOCK_SIZE + 123)
+            .map(|i| (i / 4096) as u8 ^ (i as u8))
+            .collect();
+
+        let mut codec = ParallelZstd::new(1, 4, false).unwrap();
+        let mut out = Vec::new();
+        for chunk in input.chunks(64 * 1024 + 7) {
+            codec.compress(chunk, &mut out).unwrap();
+        }
+        codec.end_frame(&mut out).unwrap();
+        assert_eq!(zstd::decode_all(&out[..]).unwrap(), input);
+
+        // Ending a frame with nothing pending adds nothing.
+        let len = out.len();
+        codec.end_frame(&mut out).unwrap();
+        assert_eq!(out.len(), len);
+    }
+}
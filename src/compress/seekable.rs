@@ -0,0 +1,140 @@
+//! The zstd seekable format: independently compressed frames followed by a
+//! skippable frame holding a seek table, so a reader can find and decompress
+//! just the frames covering the range it wants. Plain zstd decoders skip the
+//! table and read the file as an ordinary multi-frame stream.
+//!
+//! Seek table layout (little-endian), written once at close:
+//!
+//! ```text
+//! u32 0x184D2A5E      skippable frame magic
+//! u32 frame_size      bytes that follow, up to the end of the file
+//! entries             per frame: u32 compressed size, u32 decompressed size,
+//!                     and a u32 checksum if the descriptor says so
+//! u32 frame_count
+//! u8  descriptor      bit 7: entries carry checksums
+//! u32 0x8F92EAB1      seekable magic
+//! ```
+
+use crate::read_at::read_exact_at;
+use std::fs::File;
+use std::io;
+use std::path::Path;
+
+const SKIPPABLE_MAGIC: u32 = 0x184D_2A5E;
+const SEEKABLE_MAGIC: u32 = 0x8F92_EAB1;
+const FOOTER_SIZE: u64 = 9;
+const CHECKSUM_FLAG: u8 = 0x80;
+
+/// Sizes of the frames written so far, for the seek table.
+#[derive(Default)]
+pub(crate) struct SeekTable {
+    frames: Vec<(u32, u32)>,
+}
+
+impl SeekTable {
+    pub(crate) fn push(&mut self, compressed: usize, decompressed: usize) {
+        self.frames.push((compressed as u32, decompressed as u32));
+    }
+
+    /// Appends the seek table frame to `out`.
+    pub(crate) fn write_to(&self, out: &mut Vec<u8>) {
+        let frame_size = self.frames.len() * 8 + FOOTER_SIZE as usize;
+        out.reserve(8 + frame_size);
+        out.extend_from_slice(&SKIPPABLE_MAGIC.to_le_bytes());
+        out.extend_from_slice(&(frame_size as u32).to_le_bytes());
+        for &(compressed, decompressed) in &self.frames {
+            out.extend_from_slice(&compressed.to_le_bytes());
+            out.extend_from_slice(&decompressed.to_le_bytes());
+        }
+        out.extend_from_slice(&(self.frames.len() as u32).to_le_bytes());
+        out.push(0);
+        out.extend_from_slice(&SEEKABLE_MAGIC.to_le_bytes());
+    }
+}
+
+/// A frame's position in the compressed file and in the decompressed data.
+struct Frame {
+    offset: u64,
+    size: u64,
+    start: u64,
+    len: u64,
+}
+
+fn read_frames(file: &File) -> io::Result<Vec<Frame>> {
+    let invalid = || io::Error::from(io::ErrorKind::InvalidData);
+    let file_len = file.metadata()?.len();
+    if file_len < 8 + FOOTER_SIZE {
+        return Err(invalid());
+    }
+
+    let mut footer = [0u8; FOOTER_SIZE as usize];
+    read_exact_at(file, &mut footer, file_len - FOOTER_SIZE)?;
+    let count = u32::from_le_bytes(footer[0..4].try_into().unwrap()) as u64;
+    let descriptor = footer[4];
+    if u32::from_le_bytes(footer[5..9].try_into().unwrap()) != SEEKABLE_MAGIC {
+        return Err(invalid());
+    }
+
+    let entry_size = if descriptor & CHECKSUM_FLAG != 0 {
+        12
+    } else {
+        8
+    };
+    let table_len = count * entry_size + FOOTER_SIZE;
+    let table_start = file_len.checked_sub(table_len + 8).ok_or_else(invalid)?;
+    let mut table = vec![0u8; (table_len + 8) as usize];
+    read_exact_at(file, &mut table, table_start)?;
+    let word = |i: usize| u32::from_le_bytes(table[i..i + 4].try_into().unwrap());
+    if word(0) != SKIPPABLE_MAGIC || word(4) as u64 != table_len {
+        return Err(invalid());
+    }
+
+    let mut frames = Vec::with_capacity(count as usize);
+    let (mut offset, mut start) = (0u64, 0u64);
+    for i in 0..count as usize {
+        let entry = 8 + i * entry_size as usize;
+        let (size, len) = (word(entry) as u64, word(entry + 4) as u64);
+        frames.push(Frame {
+            offset,
+            size,
+            start,
+            len,
+        });
+        offset += size;
+        start += len;
+    }
+    if offset != table_start {
+        return Err(invalid());
+    }
+    Ok(frames)
+}
+
+/// Reads up to `buf.len()` bytes of decompressed data starting at `offset`
+/// from a seekable file, decompressing only the frames that overlap the
+/// range. Returns the number of bytes read, which is short only at the end
+/// of the data.
+pub fn read_seekable_range(path: &Path, offset: u64, buf: &mut [u8]) -> io::Result<usize> {
+    let file = File::open(path)?;
+    let frames = read_frames(&file)?;
+
+    let first = frames.partition_point(|f| f.start + f.len <= offset);
+    let mut filled = 0;
+    let mut compressed = Vec::new();
+    for frame in &frames[first..] {
+        if filled == buf.len() {
+            break;
+        }
+        compressed.resize(frame.size as usize, 0);
+        read_exact_at(&file, &mut compressed, frame.offset)?;
+        let data = zstd::bulk::decompress(&compressed, frame.len as usize)?;
+        if data.len() as u64 != frame.len {
+            return Err(io::ErrorKind::InvalidData.into());
+        }
+
+        let skip = (offset + filled as u64).saturating_sub(frame.start) as usize;
+        let take = (data.len() - skip).min(buf.len() - filled);
+        buf[filled..filled + take].copy_from_slice(&data[skip..skip + take]);
+        filled += take;
+    }
+    Ok(filled)
+}
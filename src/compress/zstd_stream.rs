@@ -0,0 +1,51 @@
+//! Streaming zstd: one frame per flush, so a flushed file is always complete
+//! and decodable, and frames concatenate into a valid zstd stream.
+
+use super::Codec;
+use std::io;
+use zstd::stream::raw::{Encoder, InBuffer, Operation, OutBuffer};
+use zstd::zstd_safe::CCtx;
+
+pub(crate) struct ZstdStream {
+    encoder: Encoder<'static>,
+    frame_open: bool,
+}
+
+impl ZstdStream {
+    /// `level` 0 selects zstd's default level.
+    pub(crate) fn new(level: i32) -> io::Result<Self> {
+        Ok(ZstdStream {
+            encoder: Encoder::new(level)?,
+            frame_open: false,
+        })
+    }
+}
+
+impl Codec for ZstdStream {
+    fn compress(&mut self, input: &[u8], out: &mut Vec<u8>) -> io::Result<()> {
+        let mut src = InBuffer::around(input);
+        while src.pos() < input.len() {
+            out.reserve(CCtx::out_size());
+            let mut dst = OutBuffer::around_pos(out, out.len());
+            self.encoder.run(&mut src, &mut dst)?;
+        }
+        self.frame_open |= !input.is_empty();
+        Ok(())
+    }
+
+    fn end_frame(&mut self, out: &mut Vec<u8>) -> io::Result<()> {
+        if !self.frame_open {
+            return Ok(());
+        }
+        loop {
+            out.reserve(CCtx::out_size());
+            let mut dst = OutBuffer::around_pos(out, out.len());
+            if self.encoder.finish(&mut dst, false)? == 0 {
+                break;
+            }
+        }
+        self.encoder.reinit()?;
+        self.frame_open = false;
+        Ok(())
+    }
+}
@@ -0,0 +1,126 @@
+//! CSV rows (RFC 4180 quoting): a field is quoted only if it contains the
+//! delimiter, the quote character or a line break, and quotes inside a
+//! quoted field are doubled.
+
+use crate::simd::find_any;
+use std::io::{self, Write};
+
+#[derive(Debug, Clone, Copy)]
+pub(crate) struct CsvFormat {
+    pub(crate) delimiter: u8,
+    pub(crate) quote: u8,
+}
+
+impl Default for CsvFormat {
+    fn default() -> Self {
+        CsvFormat {
+            delimiter: b',',
+            quote: b'"',
+        }
+    }
+}
+
+impl CsvFormat {
+    #[inline]
+    fn needs_quotes(&self, field: &[u8]) -> bool {
+        find_any(field, [self.delimiter, self.quote, b'\n', b'\r']).is_some()
+    }
+
+    /// Size of the row in bytes, and which of its first 64 fields need
+    /// quotes (so `write_row` does not scan them again).
+    pub(crate) fn row_len<F: AsRef<[u8]>>(&self, fields: &[F]) -> (usize, u64) {
+        // Delimiters between fields plus the newline.
+        let mut len = fields.len().max(1);
+        let mut quoted = 0u64;
+        for (i, field) in fields.iter().enumerate() {
+            let field = field.as_ref();
+            len += field.len();
+            if self.needs_quotes(field) {
+                len += 2 + self.count_quotes(field);
+                if i < 64 {
+                    quoted |= 1 << i;
+                }
+            }
+        }
+        (len, quoted)
+    }
+
+    fn count_quotes(&self, mut field: &[u8]) -> usize {
+        let q = self.quote;
+        let mut count = 0;
+        while let Some(i) = find_any(field, [q; 4]) {
+            count += 1;
+            field = &field[i + 1..];
+        }
+        count
+    }
+
+    /// Writes `fields` as one row, ending in `\n`. `quoted` is the mask
+    /// `row_len` returned for the same fields.
+    pub(crate) fn write_row<W: Write, F: AsRef<[u8]>>(
+        &self,
+        out: &mut W,
+        fields: &[F],
+        quoted: u64,
+    ) -> io::Result<()> {
+        for (i, field) in fields.iter().enumerate() {
+            let field = field.as_ref();
+            if i > 0 {
+                out.write_all(&[self.delimiter])?;
+            }
+            let needs_quotes = if i < 64 {
+                quoted >> i & 1 != 0
+            } else {
+                self.needs_quotes(field)
+            };
+            if needs_quotes {
+                self.write_quoted(out, field)?;
+            } else {
+                out.write_all(field)?;
+            }
+        }
+        out.write_all(b"\n")
+    }
+
+    fn write_quoted<W: Write>(&self, out: &mut W, mut field: &[u8]) -> io::Result<()> {
+        let q = self.quote;
+        out.write_all(&[q])?;
+        // Copy up to and including each quote, then write it a second time.
+        while let Some(i) = find_any(field, [q; 4]) {
+            out.write_all(&field[..=i])?;
+            out.write_all(&[q])?;
+            field = &field[i + 1..];
+        }
+        out.write_all(field)?;
+        out.write_all(&[q])
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_quotes_only_fields_that_need_it() {
+        let format = CsvFormat::default();
+        let fields: [&[u8]; 6] = [b"plain", b"a,b", b"say \"hi\"", b"two\nlines", b"", b"x"];
+        let (len, quoted) = format.row_len(&fields);
+        assert_eq!(quoted, 0b01110);
+
+        let mut out = Vec::new();
+        format.write_row(&mut out, &fields, quoted).unwrap();
+        assert_eq!(out, b"plain,\"a,b\",\"say \"\"hi\"\"\",\"two\nlines\",,x\n");
+        assert_eq!(out.len(), len);
+
+        let tabs = CsvFormat {
+            delimiter: b'\t',
+            quote: b'\'',
+        };
+        let fields: [&[u8]; 3] = [b"a,b", b"it's", b"c\td"];
+        let (len, quoted) = tabs.row_len(&fields);
+        let mut out = Vec::new();
+        tabs.write_row(&mut out, &fields, quoted).unwrap();
+        assert_eq!(out, b"a,b\t'it''s'\t'c\td'\n");
+        assert_eq!(out.len(), len);
+    }
+}
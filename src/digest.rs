@@ -0,0 +1,47 @@
+//! Streaming content digests of the bytes a handle writes to its file.
+
+use crate::{FileWriterDigest, FileWriterError};
+use xxhash_rust::xxh3::Xxh3Default;
+
+/// The largest digest any algorithm produces.
+pub const FILE_WRITER_DIGEST_MAX_SIZE: usize = 32;
+
+pub(crate) enum Digest {
+    Xxh3(Box<Xxh3Default>),
+    #[cfg(feature = "blake3")]
+    Blake3(Box<blake3::Hasher>),
+}
+
+impl Digest {
+    pub(crate) fn new(kind: FileWriterDigest) -> Result<Option<Self>, FileWriterError> {
+        match kind {
+            FileWriterDigest::None => Ok(None),
+            FileWriterDigest::Xxh3_128 => Ok(Some(Digest::Xxh3(Box::default()))),
+            #[cfg(feature = "blake3")]
+            FileWriterDigest::Blake3 => Ok(Some(Digest::Blake3(Box::default()))),
+            #[cfg(not(feature = "blake3"))]
+            FileWriterDigest::Blake3 => Err(FileWriterError::UnsupportedOption),
+        }
+    }
+
+    #[inline]
+    pub(crate) fn update(&mut self, data: &[u8]) {
+        match self {
+            Digest::Xxh3(h) => h.update(data),
+            #[cfg(feature = "blake3")]
+            Digest::Blake3(h) => {
+                h.update(data);
+            }
+        }
+    }
+
+    /// The digest in its canonical byte order (xxh3-128 big-endian, as
+    /// `xxhsum -H2` prints it).
+    pub(crate) fn finish(&self) -> Vec<u8> {
+        match self {
+            Digest::Xxh3(h) => h.digest128().to_be_bytes().to_vec(),
+            #[cfg(feature = "blake3")]
+            Digest::Blake3(h) => h.finalize().as_bytes().to_vec(),
+        }
+    }
+}
@@ -0,0 +1,145 @@
+//! Per-block CRC32C framing of a file's bytes: every `block_size` bytes of
+//! output are followed by a 4-byte little-endian CRC32C of that block. The
+//! last block may be short; its trailer is written when the file is closed.
+//! The checksum is computed as the data passes through on its way to the
+//! file, while it is still in cache.
+
+use crate::crc32c::crc32c;
+use crate::read_at::read_exact_at;
+use std::fs::File;
+use std::io;
+use std::path::Path;
+use std::thread;
+
+pub(crate) const TRAILER_SIZE: usize = 4;
+
+pub(crate) struct BlockCrc {
+    block_size: usize,
+    /// Bytes already in the current block, and their CRC.
+    filled: usize,
+    crc: u32,
+}
+
+impl BlockCrc {
+    pub(crate) fn new(block_size: usize) -> Self {
+        BlockCrc {
+            block_size,
+            filled: 0,
+            crc: 0,
+        }
+    }
+
+    /// Appends `data` to `out`, with a trailer after each block it completes.
+    pub(crate) fn frame(&mut self, mut data: &[u8], out: &mut Vec<u8>) {
+        out.reserve(data.len() + (data.len() / self.block_size + 1) * TRAILER_SIZE);
+        while !data.is_empty() {
+            let take = data.len().min(self.block_size - self.filled);
+            let (block, rest) = data.split_at(take);
+            self.crc = crc32c(self.crc, block);
+            out.extend_from_slice(block);
+            self.filled += take;
+            data = rest;
+            if self.filled == self.block_size {
+                self.end_block(out);
+            }
+        }
+    }
+
+    /// Writes the trailer of a partly filled last block.
+    pub(crate) fn finish(&mut self, out: &mut Vec<u8>) {
+        if self.filled > 0 {
+            self.end_block(out);
+        }
+    }
+
+    fn end_block(&mut self, out: &mut Vec<u8>) {
+        out.extend_from_slice(&self.crc.to_le_bytes());
+        self.filled = 0;
+        self.crc = 0;
+    }
+}
+
+/// Checks every block of a file written with `block_size` CRC32C framing,
+/// reading with up to `threads` threads in parallel (at most one per CPU).
+/// Returns the index of the first block whose checksum does not match, or
+/// `None` if all do.
+pub fn verify_crc_blocks(
+    path: &Path,
+    block_size: usize,
+    threads: usize,
+) -> io::Result<Option<u64>> {
+    if block_size == 0 {
+        return Err(io::ErrorKind::InvalidInput.into());
+    }
+    verify_crc_file(&File::open(path)?, block_size, threads)
+}
+
+/// `verify_crc_blocks` on a file that is already open.
+pub(crate) fn verify_crc_file(
+    file: &File,
+    block_size: usize,
+    threads: usize,
+) -> io::Result<Option<u64>> {
+    let len = file.metadata()?.len();
+    let stride = (block_size + TRAILER_SIZE) as u64;
+    let blocks = len.div_ceil(stride);
+    let cpus = thread::available_parallelism().map_or(1, |n| n.get());
+    let threads = (threads.clamp(1, cpus) as u64).min(blocks.max(1));
+
+    // Each thread takes a contiguous run of blocks.
+    let per_thread = blocks.div_ceil(threads);
+    let results = thread::scope(|scope| -> io::Result<Vec<io::Result<Option<u64>>>> {
+        let mut workers = Vec::with_capacity(threads as usize);
+        for t in 0..threads {
+            let first = t * per_thread;
+            let last = ((t + 1) * per_thread).min(blocks);
+            workers.push(thread::Builder::new().spawn_scoped(scope, move || {
+                verify_range(file, len, block_size, first..last)
+            })?);
+        }
+        Ok(workers.into_iter().map(|w| w.join().unwrap()).collect())
+    })?;
+
+    let mut bad = None;
+    for result in results {
+        // Runs are in block order, so the first failure found is the earliest.
+        if let Some(block) = result? {
+            bad = bad.or(Some(block));
+        }
+    }
+    Ok(bad)
+}
+
+fn verify_range(
+    file: &File,
+    len: u64,
+    block_size: usize,
+    blocks: std::ops::Range<u64>,
+) -> io::Result<Option<u64>> {
+    // Read many blocks per call to keep syscalls off the profile.
+    const READ_SIZE: usize = 4 * 1024 * 1024;
+    let stride = block_size + TRAILER_SIZE;
+    let per_read = (READ_SIZE / stride).max(1) as u64;
+    let mut buf = Vec::new();
+
+    let mut block = blocks.start;
+    while block < blocks.end {
+        let count = per_read.min(blocks.end - block);
+        let offset = block * stride as u64;
+        let end = (offset + count * stride as u64).min(len);
+        buf.resize((end - offset) as usize, 0);
+        read_exact_at(file, &mut buf, offset)?;
+
+        for (i, chunk) in buf.chunks(stride).enumerate() {
+            if chunk.len() <= TRAILER_SIZE {
+                return Ok(Some(block + i as u64));
+            }
+            let (data, trailer) = chunk.split_at(chunk.len() - TRAILER_SIZE);
+            if crc32c(0, data).to_le_bytes() != trailer {
+                return Ok(Some(block + i as u64));
+            }
+        }
+        block += count;
+    }
+    Ok(None)
+}
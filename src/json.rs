@@ -0,0 +1,218 @@
+//! JSON Lines: each top-level object is built member by member and ends
+//! with `\n`. `JsonState` tracks where in the object the handle is, so that
+//! the separators come out right and calls in the wrong order are refused
+//! instead of producing invalid JSON, and holds the line until it is
+//! complete.
+
+use crate::simd::find_json_escape;
+use crate::FileWriterError;
+
+/// Deepest nesting of objects supported.
+const MAX_DEPTH: u32 = 64;
+
+#[derive(Debug, Default)]
+pub(crate) struct JsonState {
+    /// Number of objects open; 0 between lines.
+    depth: u32,
+    /// Bit `d - 1` is set once the object at depth `d` has a member.
+    has_member: u64,
+    /// A key has been written and its value is expected.
+    after_key: bool,
+    /// The line being built. It is written out whole once its outermost
+    /// object ends, so an unfinished line never reaches the file.
+    line: Vec<u8>,
+}
+
+impl JsonState {
+    /// Starts an object: a new line at depth 0, otherwise the value of the
+    /// key just written.
+    pub(crate) fn begin_object(&mut self) -> Result<(), FileWriterError> {
+        if self.depth == MAX_DEPTH {
+            return Err(FileWriterError::InvalidData);
+        }
+        if self.depth > 0 {
+            self.begin_value()?;
+        }
+        self.depth += 1;
+        self.has_member &= !self.member_bit();
+        Ok(())
+    }
+
+    /// Ends the innermost object. Returns true if that ends the line.
+    pub(crate) fn end_object(&mut self) -> Result<bool, FileWriterError> {
+        if self.depth == 0 || self.after_key {
+            return Err(FileWriterError::InvalidData);
+        }
+        self.depth -= 1;
+        Ok(self.depth == 0)
+    }
+
+    /// Starts a member. Returns the separator to write before its key.
+    pub(crate) fn begin_key(&mut self) -> Result<&'static [u8], FileWriterError> {
+        if self.depth == 0 || self.after_key {
+            return Err(FileWriterError::InvalidData);
+        }
+        self.after_key = true;
+        let bit = self.member_bit();
+        let separator: &[u8] = if self.has_member & bit != 0 {
+            b","
+        } else {
+            b""
+        };
+        self.has_member |= bit;
+        Ok(separator)
+    }
+
+    /// Accepts a value for the key just written.
+    pub(crate) fn begin_value(&mut self) -> Result<(), FileWriterError> {
+        if !self.after_key {
+            return Err(FileWriterError::InvalidData);
+        }
+        self.after_key = false;
+        Ok(())
+    }
+
+    /// Appends JSON text that needs no escaping to the line.
+    pub(crate) fn push(&mut self, text: &[u8]) {
+        self.line.extend_from_slice(text);
+    }
+
+    /// Appends `s` to the line as a quoted JSON string.
+    pub(crate) fn push_string(&mut self, s: &[u8]) {
+        write_string(&mut self.line, s);
+    }
+
+    /// The line, once its outermost object has ended.
+    pub(crate) fn finished_line(&self) -> Option<&[u8]> {
+        (self.depth == 0 && !self.line.is_empty()).then_some(&self.line)
+    }
+
+    /// Drops the line, finished or not, and starts over.
+    pub(crate) fn reset(&mut self) {
+        self.depth = 0;
+        self.after_key = false;
+        self.line.clear();
+    }
+
+    fn member_bit(&self) -> u64 {
+        1 << (self.depth - 1)
+    }
+}
+
+/// Appends `s` to `out` as a quoted JSON string. Runs without anything to
+/// escape are copied as they are.
+fn write_string(out: &mut Vec<u8>, mut s: &[u8]) {
+    out.push(b'"');
+    while let Some(i) = find_json_escape(s) {
+        out.extend_from_slice(&s[..i]);
+        let escape = escape(s[i]);
+        out.extend_from_slice(&escape.bytes[..escape.len]);
+        s = &s[i + 1..];
+    }
+    out.extend_from_slice(s);
+    out.push(b'"');
+}
+
+struct Escape {
+    bytes: [u8; 6],
+    len: usize,
+}
+
+#[cold]
+fn escape(b: u8) -> Escape {
+    const HEX: &[u8; 16] = b"0123456789abcdef";
+    let short = match b {
+        b'"' => b'"',
+        b'\\' => b'\\',
+        b'\n' => b'n',
+        b'\r' => b'r',
+        b'\t' => b't',
+        0x08 => b'b',
+        0x0C => b'f',
+        _ => {
+            let bytes = [
+                b'\\',
+                b'u',
+                b'0',
+                b'0',
+                HEX[(b >> 4) as usize],
+                HEX[(b & 0xF) as usize],
+            ];
+            return Escape { bytes, len: 6 };
+        }
+    };
+    Escape {
+        bytes: [b'\\', short, 0, 0, 0, 0],
+        len: 2,
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn quoted(s: &[u8]) -> String {
+        let mut out = Vec::new();
+        write_string(&mut out, s);
+        String::from_utf8(out).unwrap()
+    }
+
+    #[test]
+    fn test_string_escaping() {
+        assert_eq!(quoted(b""), r#""""#);
+        assert_eq!(
+            quoted("plain text, ünïcode".as_bytes()),
+            r#""plain text, ünïcode""#
+        );
+        assert_eq!(quoted(b"say \"hi\"\\"), r#""say \"hi\"\\""#);
+        assert_eq!(quoted(b"a\nb\tc\r\x08\x0C"), r#""a\nb\tc\r\b\f""#);
+        assert_eq!(quoted(b"\x00\x1F"), r#""\u0000\u001f""#);
+
+        let long = "x".repeat(40) + "\"" + &"y".repeat(40);
+        assert_eq!(
+            quoted(long.as_bytes()),
+            format!("\"{}\\\"{}\"", "x".repeat(40), "y".repeat(40))
+        );
+    }
+
+    #[test]
+    fn test_state_orders_members() {
+        let mut state = JsonState::default();
+        assert_eq!(state.begin_key(), Err(FileWriterError::InvalidData));
+        state.begin_object().unwrap();
+        assert_eq!(state.begin_value(), Err(FileWriterError::InvalidData));
+        assert_eq!(state.begin_key(), Ok(&b""[..]));
+        assert_eq!(state.begin_key(), Err(FileWriterError::InvalidData));
+        state.begin_value().unwrap();
+        assert_eq!(state.begin_key(), Ok(&b","[..]));
+        state.begin_object().unwrap();
+        assert_eq!(state.begin_key(), Ok(&b""[..]));
+        state.begin_value().unwrap();
+        assert_eq!(state.end_object(), Ok(false));
+        assert_eq!(state.begin_key(), Ok(&b","[..]));
+        assert_eq!(state.end_object(), Err(FileWriterError::InvalidData));
+        state.begin_value().unwrap();
+        assert_eq!(state.end_object(), Ok(true));
+        assert_eq!(state.end_object(), Err(FileWriterError::InvalidData));
+    }
+
+    #[test]
+    fn test_line_is_held_until_it_ends() {
+        let mut state = JsonState::default();
+        state.begin_object().unwrap();
+        state.push(b"{");
+        assert_eq!(state.finished_line(), None);
+        state.end_object().unwrap();
+        state.push(b"}\n");
+        assert_eq!(state.finished_line(), Some(&b"{}\n"[..]));
+
+        state.reset();
+        state.begin_object().unwrap();
+        state.push(b"{");
+        state.begin_key().unwrap();
+        state.reset();
+        assert_eq!(state.end_object(), Err(FileWriterError::InvalidData));
+        assert_eq!(state.finished_line(), None);
+        assert_eq!(state.begin_key(), Err(FileWriterError::InvalidData));
+    }
+}
@@ -1,6 +1,35 @@
+mod background;
+mod buffer;
+mod compress;
+mod crc32c;
+mod csv;
+mod digest;
+mod integrity;
+mod json;
+mod read_at;
+mod record;
+#[cfg(unix)]
+mod recorder;
+mod retention;
+mod rotation;
+mod simd;
+mod sink;
+#[cfg(feature = "test-hooks")]
+#[doc(hidden)]
+pub mod test_hooks;
+
+use buffer::OutputBuffer;
+#[cfg(feature = "zstd")]
+pub use compress::read_seekable_range;
+pub use digest::FILE_WRITER_DIGEST_MAX_SIZE;
+pub use integrity::verify_crc_blocks;
+#[cfg(unix)]
+pub use recorder::{read_recorder, FlightRecorder};
+use rotation::Rotation;
+use sink::Sink;
 use std::ffi::{c_char, CStr};
-use std::fs::{File, OpenOptions};
-use std::io::{BufWriter, ErrorKind, Write};
+use std::fs::OpenOptions;
+use std::io::{ErrorKind, Write};
 use std::path::Path;
 use std::ptr::null_mut;
 use std::slice;
@@ -16,6 +45,7 @@ pub enum FileWriterError {
     InvalidPath = 5,
     InvalidData = 6,
     IoError = 7,
+    UnsupportedOption = 8, // Option needs a cargo feature this build lacks
 }
 
 impl From<std::io::Error> for FileWriterError {
@@ -35,9 +65,88 @@ pub enum FileWriterMode {
     Write = 1,
 }
 
+/// A `FileWriterOptions::compression` value.
+#[repr(u32)]
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub enum FileWriterCompression {
+    #[default]
+    None = 0,
+    Zstd = 1,
+    /// zstd in independent 1 MiB blocks with a seek table at the end, so
+    /// ranges can be read back without decompressing from the start.
+    ZstdSeekable = 2,
+    /// LZ4 frame format: several GB/s per core at a lower ratio than zstd.
+    /// The level and thread options do not apply.
+    Lz4 = 3,
+}
+
+impl FileWriterCompression {
+    fn from_u32(compression: u32) -> Option<Self> {
+        Some(match compression {
+            0 => FileWriterCompression::None,
+            1 => FileWriterCompression::Zstd,
+            2 => FileWriterCompression::ZstdSeekable,
+            3 => FileWriterCompression::Lz4,
+            _ => return None,
+        })
+    }
+}
+
+/// A `FileWriterOptions::digest` value.
+#[repr(u32)]
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub enum FileWriterDigest {
+    #[default]
+    None = 0,
+    /// 16-byte xxHash3-128.
+    Xxh3_128 = 1,
+    /// 32-byte BLAKE3; needs the `blake3` cargo feature.
+    Blake3 = 2,
+}
+
+impl FileWriterDigest {
+    fn from_u32(digest: u32) -> Option<Self> {
+        Some(match digest {
+            0 => FileWriterDigest::None,
+            1 => FileWriterDigest::Xxh3_128,
+            2 => FileWriterDigest::Blake3,
+            _ => return None,
+        })
+    }
+}
+
+/// Options for `file_writer_new_with_options`. All-zero is the default: no
+/// compression. The enum-valued fields are plain integers because C can
+/// store any value in them; unknown ones return `InvalidData`.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default)]
+pub struct FileWriterOptions {
+    /// A `FileWriterCompression`.
+    pub compression: u32,
+    /// Codec level; 0 picks the codec's default (zstd: 3).
+    pub compression_level: i32,
+    /// Threads compressing for this handle. 0 or 1 compresses on the writing
+    /// thread as a stream; more cut the input into 1 MiB blocks that are
+    /// compressed in parallel, each as its own frame, and written in order.
+    /// Values above the number of CPUs are capped to it.
+    pub compression_threads: u32,
+    /// When non-zero, every this many bytes of output (after compression)
+    /// are followed by a 4-byte CRC32C trailer; see `file_writer_verify`.
+    pub crc_block_size: u32,
+    /// A `FileWriterDigest`: hash every byte this handle writes to the
+    /// file, for `file_writer_close_digest`.
+    pub digest: u32,
+}
+
+/// `repr(C)` with the buffer first, so that a handle starts with the
+/// buffer's `FileWriterCursor` for the header's inline writers.
+#[repr(C)]
 pub struct FileWriter {
-    writer: Option<BufWriter<File>>,
+    writer: OutputBuffer<Sink>,
     is_valid: bool,
+    rotation: Option<Box<Rotation>>,
+    csv: csv::CsvFormat,
+    json: json::JsonState,
 }
 
 pub type FileWriterHandle = FileWriter;
@@ -45,20 +154,49 @@ pub type FileWriterHandle = FileWriter;
 #[inline(always)]
 fn get_writer_mut(
     handle: *mut FileWriterHandle,
-) -> Result<&'static mut BufWriter<File>, FileWriterError> {
+) -> Result<&'static mut OutputBuffer<Sink>, FileWriterError> {
+    unsafe {
+        if !handle.is_null() {
+            let fw = &mut *handle;
+            if fw.is_valid {
+                return Ok(&mut fw.writer);
+            }
+        }
+        Err(FileWriterError::InvalidHandle)
+    }
+}
+
+/// Like `get_writer_mut`, for a write of `len` bytes: rotating handles switch
+/// to the next file first if the write would not fit or the period is over.
+#[inline(always)]
+fn get_writer_for_write(
+    handle: *mut FileWriterHandle,
+    len: usize,
+) -> Result<&'static mut OutputBuffer<Sink>, FileWriterError> {
     unsafe {
         if !handle.is_null() {
             let fw = &mut *handle;
             if fw.is_valid {
-                if let Some(ref mut writer) = fw.writer {
-                    return Ok(writer);
+                let writer = &mut fw.writer;
+                if let Some(ref mut rotation) = fw.rotation {
+                    if rotation.before_write(writer, len).is_err() {
+                        return Err(FileWriterError::FileWriteError);
+                    }
                 }
+                return Ok(writer);
             }
         }
         Err(FileWriterError::InvalidHandle)
     }
 }
 
+fn c_str_arg<'a>(ptr: *const c_char) -> Option<&'a str> {
+    if ptr.is_null() {
+        return None;
+    }
+    unsafe { CStr::from_ptr(ptr) }.to_str().ok()
+}
+
 /// # Safety
 /// - `path` must be a valid null-terminated C string
 /// - `handle` must be a valid pointer to store the result
@@ -67,6 +205,48 @@ pub unsafe extern "C" fn file_writer_new(
     path: *const c_char,
     handle: *mut *mut FileWriterHandle,
     mode: FileWriterMode,
+) -> FileWriterError {
+    unsafe { file_writer_new_with_options(path, handle, mode, std::ptr::null()) }
+}
+
+/// Like `file_writer_new`, with `options` (NULL for the defaults).
+///
+/// With `FileWriterCompression::Zstd` everything written is fed through a
+/// streaming zstd encoder between the buffer and the file. Each
+/// `file_writer_flush`, `file_writer_sync` and `file_writer_close` ends the
+/// current frame, so the file is a valid (multi-frame) zstd stream after
+/// each of them. `FileWriterCompression::ZstdSeekable` additionally writes a
+/// seek table on close (see `file_writer_read_range`); both need the `zstd`
+/// cargo feature. `FileWriterCompression::Lz4` writes LZ4 frames, likewise
+/// ended on each flush, and needs the `lz4` feature. Without the feature a
+/// codec needs this returns `UnsupportedOption`.
+///
+/// The seek table indexes frames laid back to back from the start of the
+/// file, so `ZstdSeekable` with `FileWriterMode::Append` or a non-zero
+/// `crc_block_size` returns `InvalidData`.
+///
+/// A non-zero `crc_block_size` frames the bytes written to the file into
+/// blocks of that size, each followed by its CRC32C; the last, short block
+/// gets its trailer on close. See `file_writer_verify`. The blocks are
+/// counted from the start of the file, which an appending handle does not
+/// know, so `FileWriterMode::Append` with a non-zero `crc_block_size`
+/// returns `InvalidData`.
+///
+/// `digest` hashes the bytes as they are written to the file (compressed
+/// and framed, if so configured), so the digest matches hashing the
+/// finished file, or with `FileWriterMode::Append` just the bytes this
+/// handle added; `file_writer_close_digest` returns it.
+///
+/// # Safety
+/// - `path` must be a valid null-terminated C string
+/// - `handle` must be a valid pointer to store the result
+/// - `options` must be NULL or point to a valid FileWriterOptions
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_new_with_options(
+    path: *const c_char,
+    handle: *mut *mut FileWriterHandle,
+    mode: FileWriterMode,
+    options: *const FileWriterOptions,
 ) -> FileWriterError {
     if path.is_null() {
         return FileWriterError::InvalidPath;
@@ -76,6 +256,30 @@ pub unsafe extern "C" fn file_writer_new(
     }
     unsafe { *handle = null_mut() };
 
+    let options = unsafe { options.as_ref() }.copied().unwrap_or_default();
+    let (Some(compression), Some(digest)) = (
+        FileWriterCompression::from_u32(options.compression),
+        FileWriterDigest::from_u32(options.digest),
+    ) else {
+        return FileWriterError::InvalidData;
+    };
+    if mode == FileWriterMode::Append && options.crc_block_size > 0 {
+        return FileWriterError::InvalidData;
+    }
+    if compression == FileWriterCompression::ZstdSeekable
+        && (mode == FileWriterMode::Append || options.crc_block_size > 0)
+    {
+        return FileWriterError::InvalidData;
+    }
+    let codec = match compress::new_codec(compression, &options) {
+        Ok(c) => c,
+        Err(e) => return e,
+    };
+    let digest = match digest::Digest::new(digest) {
+        Ok(d) => d,
+        Err(e) => return e,
+    };
+
     let c_str = unsafe { CStr::from_ptr(path) };
     let path_str = match c_str.to_str() {
         Ok(s) => s,
@@ -104,11 +308,18 @@ pub unsafe extern "C" fn file_writer_new(
         Err(_) => return FileWriterError::FileOpenError,
     };
 
-    let writer = BufWriter::with_capacity(64 * 1024, file);
+    let block_crc = (options.crc_block_size > 0)
+        .then(|| integrity::BlockCrc::new(options.crc_block_size as usize));
+    let sink = Sink::with_stages(file, codec, block_crc, digest);
+    let mut writer = OutputBuffer::with_capacity(64 * 1024, sink);
+    writer.set_inline_writes(true);
 
     let file_writer = FileWriter {
-        writer: Some(writer),
+        writer,
         is_valid: true,
+        rotation: None,
+        csv: Default::default(),
+        json: Default::default(),
     };
 
     let boxed_writer = Box::new(file_writer);
@@ -119,6 +330,142 @@ pub unsafe extern "C" fn file_writer_new(
     FileWriterError::Success
 }
 
+/// Opens a writer that splits its output into numbered segment files in
+/// `dir`. `name_template` must contain `{}` once, which is replaced by the
+/// zero-padded segment index (e.g. `"app-{}.log"` gives `app-000000.log`);
+/// numbering continues after segments already present in `dir`.
+///
+/// A write that would take the current segment past `segment_size` bytes goes
+/// to a new segment instead, so records are never split across files. The
+/// next segment is created and preallocated in the background ahead of time,
+/// and the finished one is flushed and closed in the background; errors from
+/// those closes are reported by `file_writer_close`. Writes never wait for
+/// the next segment: if it is not ready yet, they go on to the current one,
+/// which then ends up larger than `segment_size`.
+///
+/// # Safety
+/// - `dir` and `name_template` must be valid null-terminated C strings
+/// - `handle` must be a valid pointer to store the result
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_new_segmented(
+    dir: *const c_char,
+    name_template: *const c_char,
+    segment_size: u64,
+    handle: *mut *mut FileWriterHandle,
+) -> FileWriterError {
+    if handle.is_null() {
+        return FileWriterError::InvalidHandle;
+    }
+    unsafe { *handle = null_mut() };
+
+    let (dir, template) = match (c_str_arg(dir), c_str_arg(name_template)) {
+        (Some(d), Some(t)) => (d, t),
+        _ => return FileWriterError::InvalidPath,
+    };
+    if segment_size == 0 {
+        return FileWriterError::InvalidData;
+    }
+
+    let rotation = Rotation::segmented(Path::new(dir), template, segment_size, 64 * 1024);
+    unsafe { new_rotating_handle(rotation, handle) }
+}
+
+/// Opens a writer that switches to a new file at every `period_secs`
+/// boundary of wall-clock time (UTC, aligned to the Unix epoch, so 3600
+/// switches at the top of each hour). The file for a period is
+/// `dir`/`pattern` with `%Y %m %d %H %M %S` expanded for the period's start;
+/// `pattern` may contain subdirectories. Files are opened for append, so a
+/// restarted writer continues the current period's file.
+///
+/// The next file is opened by a background thread shortly before the
+/// boundary (spread over up to 30 seconds across handles), and the switch
+/// happens on the first write after the boundary. Writes never wait for the
+/// next file: if it is not open yet, they go on to the previous period's
+/// file until it is. The previous file is flushed and closed in the
+/// background.
+///
+/// # Safety
+/// - `dir` and `pattern` must be valid null-terminated C strings
+/// - `handle` must be a valid pointer to store the result
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_new_rotating(
+    dir: *const c_char,
+    pattern: *const c_char,
+    period_secs: u64,
+    handle: *mut *mut FileWriterHandle,
+) -> FileWriterError {
+    if handle.is_null() {
+        return FileWriterError::InvalidHandle;
+    }
+    unsafe { *handle = null_mut() };
+
+    let (dir, pattern) = match (c_str_arg(dir), c_str_arg(pattern)) {
+        (Some(d), Some(p)) => (d, p),
+        _ => return FileWriterError::InvalidPath,
+    };
+    if period_secs == 0 {
+        return FileWriterError::InvalidData;
+    }
+
+    let rotation = Rotation::timed(Path::new(dir), pattern, period_secs, 64 * 1024);
+    unsafe { new_rotating_handle(rotation, handle) }
+}
+
+/// Makes a segmented or rotating handle delete its oldest files, in the
+/// background, once more than `max_files` files exist (counting the one being
+/// written) or the closed files add up to more than `max_bytes`. A limit of 0
+/// disables that rule. Files from earlier runs that match the naming scheme
+/// count too. Deletion is rate-limited to `delete_bytes_per_sec` (0 = as fast
+/// as possible): large files are truncated step by step before the unlink so
+/// freeing them does not stall the writing thread on the filesystem journal.
+///
+/// # Safety
+/// - `handle` must be a valid FileWriterHandle pointer
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_set_retention(
+    handle: *mut FileWriterHandle,
+    max_files: u64,
+    max_bytes: u64,
+    delete_bytes_per_sec: u64,
+) -> FileWriterError {
+    let rotation = unsafe {
+        match handle.as_mut().and_then(|fw| fw.rotation.as_mut()) {
+            Some(r) => r,
+            None => return FileWriterError::InvalidHandle,
+        }
+    };
+
+    match rotation.set_retention(max_files, max_bytes, delete_bytes_per_sec) {
+        Ok(_) => FileWriterError::Success,
+        Err(e) => e.into(),
+    }
+}
+
+unsafe fn new_rotating_handle(
+    rotation: std::io::Result<(Rotation, OutputBuffer<Sink>)>,
+    handle: *mut *mut FileWriterHandle,
+) -> FileWriterError {
+    let (rotation, writer) = match rotation {
+        Ok(r) => r,
+        Err(e) if e.kind() == ErrorKind::InvalidInput => return FileWriterError::InvalidPath,
+        Err(_) => return FileWriterError::FileOpenError,
+    };
+
+    let file_writer = FileWriter {
+        writer,
+        is_valid: true,
+        rotation: Some(Box::new(rotation)),
+        csv: Default::default(),
+        json: Default::default(),
+    };
+
+    unsafe {
+        *handle = Box::into_raw(Box::new(file_writer));
+    }
+
+    FileWriterError::Success
+}
+
 /// # Safety
 /// - `handle` must be a valid FileWriterHandle pointer
 #[no_mangle]
@@ -137,20 +484,20 @@ pub unsafe extern "C" fn file_writer_set_buffer_size(
         }
     };
 
-    let old_writer = match file_writer.writer.take() {
-        Some(w) => w,
-        None => return FileWriterError::InvalidHandle,
-    };
+    if !file_writer.is_valid {
+        return FileWriterError::InvalidHandle;
+    }
 
-    match old_writer.into_inner() {
-        Ok(file) => {
-            let new_writer = BufWriter::with_capacity(size, file);
-            file_writer.writer = Some(new_writer);
-            file_writer.is_valid = true;
+    match file_writer.writer.set_capacity(size) {
+        Ok(()) => {
+            if let Some(ref mut rotation) = file_writer.rotation {
+                rotation.set_capacity(size);
+            }
             FileWriterError::Success
         }
         Err(_e) => {
             file_writer.is_valid = false;
+            file_writer.writer.set_inline_writes(false);
             FileWriterError::FileCloseError
         }
     }
@@ -173,7 +520,7 @@ pub unsafe extern "C" fn file_writer_write_raw(
         return FileWriterError::InvalidData;
     }
 
-    let writer = match get_writer_mut(handle) {
+    let writer = match get_writer_for_write(handle, size) {
         Ok(w) => w,
         Err(e) => return e,
     };
@@ -198,20 +545,36 @@ pub unsafe extern "C" fn file_writer_write_string(
         return FileWriterError::InvalidData;
     }
 
-    let writer = match get_writer_mut(handle) {
+    let c_str = unsafe { CStr::from_ptr(str_ptr) };
+    let bytes = c_str.to_bytes();
+
+    let writer = match get_writer_for_write(handle, bytes.len()) {
         Ok(w) => w,
         Err(e) => return e,
     };
 
-    let c_str = unsafe { CStr::from_ptr(str_ptr) };
-    let bytes = c_str.to_bytes();
-
     match writer.write_all(bytes) {
         Ok(_) => FileWriterError::Success,
         Err(_) => FileWriterError::FileWriteError,
     }
 }
 
+/// Writes the `len` bytes of text at `str_ptr`: `file_writer_write_string`
+/// for callers that already know the length (no NUL needed, none scanned
+/// for).
+///
+/// # Safety
+/// - `handle` must be a valid FileWriterHandle pointer
+/// - `str_ptr` must point to valid memory of at least `len` bytes
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_write_string_n(
+    handle: *mut FileWriterHandle,
+    str_ptr: *const c_char,
+    len: usize,
+) -> FileWriterError {
+    unsafe { file_writer_write_raw(handle, str_ptr.cast(), len) }
+}
+
 /// # Safety
 /// - `handle` must be a valid FileWriterHandle pointer
 #[no_mangle]
@@ -227,12 +590,65 @@ pub unsafe extern "C" fn file_writer_flush(handle: *mut FileWriterHandle) -> Fil
     }
 }
 
+/// Flushes the internal buffer and asks the OS to persist the file data
+/// (`fdatasync`). Data acknowledged by `file_writer_flush` survives a process
+/// crash; data acknowledged by this call also survives a power loss.
+///
+/// # Safety
+/// - `handle` must be a valid FileWriterHandle pointer
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_sync(handle: *mut FileWriterHandle) -> FileWriterError {
+    let writer = match get_writer_mut(handle) {
+        Ok(w) => w,
+        Err(e) => return e,
+    };
+
+    if writer.flush().is_err() {
+        return FileWriterError::FileWriteError;
+    }
+
+    match writer.get_ref().sync_data() {
+        Ok(_) => FileWriterError::Success,
+        Err(_) => FileWriterError::IoError,
+    }
+}
+
 #[repr(C)]
 pub struct BufferDescriptor {
     pub data: *const u8,
     pub size: usize,
 }
 
+/// A `BufferDescriptor` whose `data` is known to be valid for `size` bytes.
+#[repr(transparent)]
+struct CheckedBuffer(BufferDescriptor);
+
+impl AsRef<[u8]> for CheckedBuffer {
+    #[inline(always)]
+    fn as_ref(&self) -> &[u8] {
+        if self.0.size == 0 {
+            return &[];
+        }
+        unsafe { slice::from_raw_parts(self.0.data, self.0.size) }
+    }
+}
+
+/// Views `count` descriptors as slices, or `None` if one has a null `data`
+/// with a non-zero `size`.
+///
+/// # Safety
+/// `buffers` must point to `count` descriptors, each valid as documented.
+unsafe fn checked_buffers<'a>(
+    buffers: *const BufferDescriptor,
+    count: usize,
+) -> Option<&'a [CheckedBuffer]> {
+    let buffers = unsafe { slice::from_raw_parts(buffers, count) };
+    if buffers.iter().any(|b| b.data.is_null() && b.size > 0) {
+        return None;
+    }
+    Some(unsafe { &*(buffers as *const [BufferDescriptor] as *const [CheckedBuffer]) })
+}
+
 /// # Safety
 /// - `handle` must be a valid FileWriterHandle pointer
 /// - `buffers` must point to valid BufferDescriptor array of `count` elements
@@ -250,26 +666,184 @@ pub unsafe extern "C" fn file_writer_write_batch(
         return FileWriterError::Success;
     }
 
-    let writer = match get_writer_mut(handle) {
+    let buffers = match unsafe { checked_buffers(buffers, count) } {
+        Some(b) => b,
+        None => return FileWriterError::InvalidData,
+    };
+    let total_size = buffers.iter().map(|b| b.0.size).sum();
+
+    let writer = match get_writer_for_write(handle, total_size) {
         Ok(w) => w,
         Err(e) => return e,
     };
 
-    let buffer_slice = unsafe { slice::from_raw_parts(buffers, count) };
+    for buffer in buffers {
+        if writer.write_all(buffer.as_ref()).is_err() {
+            return FileWriterError::FileWriteError;
+        }
+    }
+
+    FileWriterError::Success
+}
+
+/// An operation for `file_writer_submit`, stored in
+/// `FileWriterCommand::op` as its `u32` value.
+#[repr(u32)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum FileWriterOp {
+    /// `value` bytes at `data`.
+    WriteBytes = 0,
+    /// The NUL-terminated string at `data`.
+    WriteString = 1,
+    /// `value` in decimal.
+    WriteU64 = 2,
+    /// Zero bytes up to the next multiple of `value` (non-zero), counted
+    /// from the start of the current file, or for appending handles from
+    /// where the handle started; before compression.
+    Align = 3,
+    /// Like `file_writer_flush`.
+    Flush = 4,
+}
+
+impl FileWriterOp {
+    fn from_u32(op: u32) -> Option<Self> {
+        Some(match op {
+            0 => FileWriterOp::WriteBytes,
+            1 => FileWriterOp::WriteString,
+            2 => FileWriterOp::WriteU64,
+            3 => FileWriterOp::Align,
+            4 => FileWriterOp::Flush,
+            _ => return None,
+        })
+    }
+}
+
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct FileWriterCommand {
+    /// A `FileWriterOp`. Kept as a plain integer because it comes from C,
+    /// where any value can be stored; unknown ones return `InvalidData`.
+    pub op: u32,
+    pub data: *const u8,
+    pub value: u64,
+}
+
+/// Runs `count` commands in order with one call, checking the handle once.
+/// Stops at the first command that fails and returns its error; the ones
+/// before it have been carried out. Each write is one unit for segmented
+/// handles, as if made by its own call. An `op` that is not a
+/// `FileWriterOp` fails with `InvalidData`.
+///
+/// # Safety
+/// - `handle` must be a valid FileWriterHandle pointer
+/// - `commands` must point to `count` commands, each with `data` valid for
+///   its operation
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_submit(
+    handle: *mut FileWriterHandle,
+    commands: *const FileWriterCommand,
+    count: usize,
+) -> FileWriterError {
+    if commands.is_null() {
+        return FileWriterError::InvalidData;
+    }
+    if handle.is_null() || !unsafe { (*handle).is_valid } {
+        return FileWriterError::InvalidHandle;
+    }
+
+    let fw = unsafe { &mut *handle };
+    let commands = unsafe { slice::from_raw_parts(commands, count) };
+    for command in commands {
+        if let Err(e) = unsafe { run_command(fw, command) } {
+            return e;
+        }
+    }
+
+    FileWriterError::Success
+}
 
-    for buffer in buffer_slice {
-        if buffer.size > 0 {
-            if buffer.data.is_null() {
-                return FileWriterError::InvalidData;
+/// # Safety
+/// `command.data` must be valid for its operation.
+#[inline(always)]
+unsafe fn run_command(
+    fw: &mut FileWriter,
+    command: &FileWriterCommand,
+) -> Result<(), FileWriterError> {
+    let Some(op) = FileWriterOp::from_u32(command.op) else {
+        return Err(FileWriterError::InvalidData);
+    };
+    match op {
+        FileWriterOp::WriteBytes => {
+            let size = command.value as usize;
+            if size == 0 {
+                return Ok(());
+            }
+            if command.data.is_null() {
+                return Err(FileWriterError::InvalidData);
+            }
+            write_unit(fw, unsafe { slice::from_raw_parts(command.data, size) })
+        }
+        FileWriterOp::WriteString => {
+            if command.data.is_null() {
+                return Err(FileWriterError::InvalidData);
+            }
+            write_unit(
+                fw,
+                unsafe { CStr::from_ptr(command.data.cast()) }.to_bytes(),
+            )
+        }
+        FileWriterOp::WriteU64 => {
+            let mut buf = itoa::Buffer::new();
+            write_unit(fw, buf.format(command.value).as_bytes())
+        }
+        FileWriterOp::Align => {
+            if command.value == 0 {
+                return Err(FileWriterError::InvalidData);
+            }
+            let mut pad = padding(fw.writer.position(), command.value);
+            if let Some(ref mut rotation) = fw.rotation {
+                // Starting a new file may leave nothing to pad.
+                if rotation.roll_if_full(&mut fw.writer, pad).is_err() {
+                    return Err(FileWriterError::FileWriteError);
+                }
+                pad = padding(fw.writer.position(), command.value);
+                rotation.extend(pad);
             }
-            let data_slice = unsafe { slice::from_raw_parts(buffer.data, buffer.size) };
-            if writer.write_all(data_slice).is_err() {
-                return FileWriterError::FileWriteError;
+            const ZEROS: [u8; 256] = [0; 256];
+            while pad > 0 {
+                let n = pad.min(ZEROS.len());
+                if fw.writer.write_all(&ZEROS[..n]).is_err() {
+                    return Err(FileWriterError::FileWriteError);
+                }
+                pad -= n;
             }
+            Ok(())
         }
+        FileWriterOp::Flush => fw
+            .writer
+            .flush()
+            .map_err(|_| FileWriterError::FileWriteError),
     }
+}
 
-    FileWriterError::Success
+#[inline(always)]
+fn write_unit(fw: &mut FileWriter, bytes: &[u8]) -> Result<(), FileWriterError> {
+    if let Some(ref mut rotation) = fw.rotation {
+        if rotation.before_write(&mut fw.writer, bytes.len()).is_err() {
+            return Err(FileWriterError::FileWriteError);
+        }
+    }
+    fw.writer
+        .write_all(bytes)
+        .map_err(|_| FileWriterError::FileWriteError)
+}
+
+#[inline(always)]
+fn padding(position: u64, alignment: u64) -> usize {
+    if alignment.is_power_of_two() {
+        return (position.wrapping_neg() & (alignment - 1)) as usize;
+    }
+    ((alignment - position % alignment) % alignment) as usize
 }
 
 /// # Safety
@@ -290,7 +864,7 @@ pub unsafe extern "C" fn file_writer_write_large(
         return FileWriterError::InvalidData;
     }
 
-    let writer = match get_writer_mut(handle) {
+    let writer = match get_writer_for_write(handle, size) {
         Ok(w) => w,
         Err(e) => return e,
     };
@@ -298,11 +872,8 @@ pub unsafe extern "C" fn file_writer_write_large(
     let data_slice = unsafe { slice::from_raw_parts(data, size) };
 
     if size > 1024 * 1024 {
-        if writer.flush().is_err() {
-            return FileWriterError::FileWriteError;
-        }
-
-        if writer.get_mut().write_all(data_slice).is_err() {
+        // Not `flush`: that would also end a compression frame.
+        if writer.write_unbuffered(data_slice).is_err() {
             return FileWriterError::FileWriteError;
         }
     } else if writer.write_all(data_slice).is_err() {
@@ -312,66 +883,1944 @@ pub unsafe extern "C" fn file_writer_write_large(
     FileWriterError::Success
 }
 
+/// Writes one record: the LEB128 varint of `size`, then the `size` bytes
+/// at `data`. Segmented handles never split a record across segments.
+///
 /// # Safety
 /// - `handle` must be a valid FileWriterHandle pointer
+/// - `data` must point to valid memory of at least `size` bytes
 #[no_mangle]
-pub unsafe extern "C" fn file_writer_close(handle: *mut FileWriterHandle) -> FileWriterError {
-    if handle.is_null() {
-        return FileWriterError::InvalidHandle;
+pub unsafe extern "C" fn file_writer_write_record(
+    handle: *mut FileWriterHandle,
+    data: *const u8,
+    size: usize,
+) -> FileWriterError {
+    if data.is_null() && size > 0 {
+        return FileWriterError::InvalidData;
     }
 
-    let boxed_writer = unsafe { Box::from_raw(handle) };
+    let writer = match get_writer_for_write(handle, record::varint_len(size as u64) + size) {
+        Ok(w) => w,
+        Err(e) => return e,
+    };
 
-    if let Some(writer) = boxed_writer.writer {
-        match writer.into_inner() {
-            Ok(_file) => FileWriterError::Success,
-            Err(_) => FileWriterError::FileCloseError,
-        }
+    let payload = if size == 0 {
+        &[][..]
     } else {
-        FileWriterError::InvalidHandle
+        unsafe { slice::from_raw_parts(data, size) }
+    };
+    match write_record(writer, payload) {
+        Ok(_) => FileWriterError::Success,
+        Err(_) => FileWriterError::FileWriteError,
     }
 }
 
-#[cfg(test)]
-mod tests {
-    use super::*;
-    use std::ffi::CString;
-    use tempfile::TempDir;
+/// Writes `count` records, one per descriptor, as `file_writer_write_record`
+/// would, in a single call. Segmented handles keep the whole batch in one
+/// segment.
+///
+/// # Safety
+/// - `handle` must be a valid FileWriterHandle pointer
+/// - `records` must point to valid BufferDescriptor array of `count` elements
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_write_records(
+    handle: *mut FileWriterHandle,
+    records: *const BufferDescriptor,
+    count: usize,
+) -> FileWriterError {
+    if records.is_null() {
+        return FileWriterError::InvalidData;
+    }
 
-    #[test]
-    fn test_create_directories() {
-        // Create a temporary directory that will be automatically cleaned up
-        let temp_dir = TempDir::new().expect("Failed to create temp dir");
-        let base_path = temp_dir.path();
+    if count == 0 {
+        return FileWriterError::Success;
+    }
 
-        // Create a path with non-existent subdirectories
+    let records = unsafe { slice::from_raw_parts(records, count) };
+    let mut total_size = 0;
+    for r in records {
+        if r.data.is_null() && r.size > 0 {
+            return FileWriterError::InvalidData;
+        }
+        total_size += record::varint_len(r.size as u64) + r.size;
+    }
+
+    let writer = match get_writer_for_write(handle, total_size) {
+        Ok(w) => w,
+        Err(e) => return e,
+    };
+
+    for r in records {
+        let payload = if r.size == 0 {
+            &[][..]
+        } else {
+            unsafe { slice::from_raw_parts(r.data, r.size) }
+        };
+        if write_record(writer, payload).is_err() {
+            return FileWriterError::FileWriteError;
+        }
+    }
+
+    FileWriterError::Success
+}
+
+#[inline(always)]
+fn write_record(writer: &mut OutputBuffer<Sink>, payload: &[u8]) -> std::io::Result<()> {
+    let mut prefix = [0u8; record::MAX_VARINT_LEN];
+    let prefix_len = record::encode_varint(payload.len() as u64, &mut prefix);
+    writer.write_all(&prefix[..prefix_len])?;
+    writer.write_all(payload)
+}
+
+/// Writes `value` in decimal.
+///
+/// # Safety
+/// - `handle` must be a valid FileWriterHandle pointer
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_write_u64(
+    handle: *mut FileWriterHandle,
+    value: u64,
+) -> FileWriterError {
+    let mut buf = itoa::Buffer::new();
+    write_formatted(handle, buf.format(value))
+}
+
+/// Writes `value` in decimal, with a leading `-` if negative.
+///
+/// # Safety
+/// - `handle` must be a valid FileWriterHandle pointer
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_write_i64(
+    handle: *mut FileWriterHandle,
+    value: i64,
+) -> FileWriterError {
+    let mut buf = itoa::Buffer::new();
+    write_formatted(handle, buf.format(value))
+}
+
+/// Writes `value` as the shortest decimal that parses back to the same
+/// double (Ryu), e.g. `0.1`, `1.0`, `1e300`. NaN and infinities are written
+/// as `NaN`, `inf` and `-inf`.
+///
+/// # Safety
+/// - `handle` must be a valid FileWriterHandle pointer
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_write_f64(
+    handle: *mut FileWriterHandle,
+    value: f64,
+) -> FileWriterError {
+    let mut buf = ryu::Buffer::new();
+    write_formatted(handle, buf.format(value))
+}
+
+#[inline(always)]
+fn write_formatted(handle: *mut FileWriterHandle, text: &str) -> FileWriterError {
+    let writer = match get_writer_for_write(handle, text.len()) {
+        Ok(w) => w,
+        Err(e) => return e,
+    };
+
+    match writer.write_all(text.as_bytes()) {
+        Ok(_) => FileWriterError::Success,
+        Err(_) => FileWriterError::FileWriteError,
+    }
+}
+
+/// Hands out at least `min_size` bytes of free space in the handle's
+/// buffer to write into in place, storing its address in `data` and its
+/// full size in `available`. The buffer is written out first when there is
+/// not enough free space, and grown until the commit if it is smaller than
+/// `min_size`. Nothing is added to the output until `file_writer_commit`; a
+/// reservation that is not committed is simply dropped by the next call on
+/// the handle.
+///
+/// # Safety
+/// - `handle` must be a valid FileWriterHandle pointer
+/// - `data` and `available` must be valid pointers to store the result
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_reserve(
+    handle: *mut FileWriterHandle,
+    min_size: usize,
+    data: *mut *mut u8,
+    available: *mut usize,
+) -> FileWriterError {
+    if data.is_null() || available.is_null() {
+        return FileWriterError::InvalidData;
+    }
+    let fw = match unsafe { handle.as_mut() } {
+        Some(fw) if fw.is_valid => fw,
+        _ => return FileWriterError::InvalidHandle,
+    };
+    match fw.writer.reserve(min_size) {
+        Ok(space) => {
+            unsafe {
+                *data = space.as_mut_ptr();
+                *available = space.len();
+            }
+            FileWriterError::Success
+        }
+        Err(_) => FileWriterError::FileWriteError,
+    }
+}
+
+/// Adds the first `size` bytes of the last `file_writer_reserve`d space to
+/// the output. `size` may be smaller than the `min_size` asked for, but not
+/// larger than the space available (`InvalidData`).
+///
+/// Segmented and timed handles switch to the next file here, if the
+/// committed bytes belong there; only committed bytes count towards a
+/// segment's size. A reservation that made the buffer grow is written out
+/// now, and the buffer shrinks back.
+///
+/// # Safety
+/// - `handle` must be a valid FileWriterHandle pointer
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_commit(
+    handle: *mut FileWriterHandle,
+    size: usize,
+) -> FileWriterError {
+    let fw = match unsafe { handle.as_mut() } {
+        Some(fw) if fw.is_valid => fw,
+        _ => return FileWriterError::InvalidHandle,
+    };
+    let writer = &mut fw.writer;
+    let result = match fw.rotation {
+        Some(ref mut rotation) => rotation.commit(writer, size),
+        None => writer.commit(size),
+    };
+    match result {
+        Ok(()) => FileWriterError::Success,
+        Err(e) if e.kind() == std::io::ErrorKind::InvalidInput => FileWriterError::InvalidData,
+        Err(_) => FileWriterError::FileWriteError,
+    }
+}
+
+/// Sets the delimiter and quote character `file_writer_csv_row` uses for
+/// this handle (by default `,` and `"`). They must be distinct ASCII
+/// characters other than CR and LF.
+///
+/// # Safety
+/// - `handle` must be a valid FileWriterHandle pointer
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_csv_set_format(
+    handle: *mut FileWriterHandle,
+    delimiter: c_char,
+    quote: c_char,
+) -> FileWriterError {
+    let file_writer = match unsafe { handle.as_mut() } {
+        Some(fw) if fw.is_valid => fw,
+        _ => return FileWriterError::InvalidHandle,
+    };
+    let (delimiter, quote) = (delimiter as u8, quote as u8);
+    let valid = |c: u8| c.is_ascii() && c != b'\n' && c != b'\r';
+    if !valid(delimiter) || !valid(quote) || delimiter == quote {
+        return FileWriterError::InvalidData;
+    }
+
+    file_writer.csv = csv::CsvFormat { delimiter, quote };
+    FileWriterError::Success
+}
+
+/// Writes one CSV row of `count` fields followed by `\n`. Fields containing
+/// the delimiter, the quote character, CR or LF are quoted, with embedded
+/// quotes doubled; all others are copied as they are. Segmented handles
+/// never split a row across segments.
+///
+/// # Safety
+/// - `handle` must be a valid FileWriterHandle pointer
+/// - `fields` must point to valid BufferDescriptor array of `count` elements
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_csv_row(
+    handle: *mut FileWriterHandle,
+    fields: *const BufferDescriptor,
+    count: usize,
+) -> FileWriterError {
+    if fields.is_null() && count > 0 {
+        return FileWriterError::InvalidData;
+    }
+    let fields = match count {
+        0 => &[],
+        _ => match unsafe { checked_buffers(fields, count) } {
+            Some(f) => f,
+            None => return FileWriterError::InvalidData,
+        },
+    };
+    let format = match unsafe { handle.as_ref() } {
+        Some(fw) => fw.csv,
+        None => return FileWriterError::InvalidHandle,
+    };
+
+    let (len, quoted) = format.row_len(fields);
+    let writer = match get_writer_for_write(handle, len) {
+        Ok(w) => w,
+        Err(e) => return e,
+    };
+
+    match format.write_row(writer, fields, quoted) {
+        Ok(_) => FileWriterError::Success,
+        Err(_) => FileWriterError::FileWriteError,
+    }
+}
+
+/// Runs one step of building a JSON line in the handle's `JsonState`. The
+/// step that ends the line writes it out in one piece, so a segmented
+/// handle never splits a line across files and a line given up part way
+/// never reaches the file. The line is dropped whether or not that write
+/// succeeds.
+fn json_step<F>(handle: *mut FileWriterHandle, step: F) -> FileWriterError
+where
+    F: FnOnce(&mut json::JsonState) -> Result<(), FileWriterError>,
+{
+    let fw = match unsafe { handle.as_mut() } {
+        Some(fw) if fw.is_valid => fw,
+        _ => return FileWriterError::InvalidHandle,
+    };
+    if let Err(e) = step(&mut fw.json) {
+        return e;
+    }
+    let Some(line) = fw.json.finished_line() else {
+        return FileWriterError::Success;
+    };
+
+    let writer = &mut fw.writer;
+    let result = match fw.rotation {
+        Some(ref mut rotation) => rotation.before_write(writer, line.len()),
+        None => Ok(()),
+    }
+    .and_then(|()| writer.write_all(line));
+    fw.json.reset();
+    match result {
+        Ok(()) => FileWriterError::Success,
+        Err(_) => FileWriterError::FileWriteError,
+    }
+}
+
+/// Writes a JSON value that needs no escaping.
+fn json_scalar(handle: *mut FileWriterHandle, text: &str) -> FileWriterError {
+    json_step(handle, |state| {
+        state.begin_value()?;
+        state.push(text.as_bytes());
+        Ok(())
+    })
+}
+
+/// Views `data`/`size` as a byte slice; `None` if `data` is null and `size`
+/// is not 0.
+///
+/// # Safety
+/// `data` must be valid for reads of `size` bytes.
+unsafe fn bytes_arg<'a>(data: *const c_char, size: usize) -> Option<&'a [u8]> {
+    match (data.is_null(), size) {
+        (_, 0) => Some(&[]),
+        (true, _) => None,
+        (false, _) => Some(unsafe { slice::from_raw_parts(data.cast(), size) }),
+    }
+}
+
+/// Starts a JSON object: a new line when none is open, otherwise the value
+/// of the key just written.
+///
+/// The `file_writer_json_*` calls build one JSON Lines record at a time.
+/// The record is held by the handle until its outermost object ends and is
+/// then written in one piece. A call out of order (a value with no key, a
+/// key with no open object, ...) returns `InvalidData` and adds nothing.
+///
+/// # Safety
+/// - `handle` must be a valid FileWriterHandle pointer
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_json_begin_object(
+    handle: *mut FileWriterHandle,
+) -> FileWriterError {
+    json_step(handle, |state| {
+        state.begin_object()?;
+        state.push(b"{");
+        Ok(())
+    })
+}
+
+/// Ends the innermost object, and the line with `\n` if it is the outermost.
+/// Ending the line writes it; if that fails this returns `FileWriteError`
+/// and the line is dropped.
+///
+/// # Safety
+/// - `handle` must be a valid FileWriterHandle pointer
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_json_end_object(
+    handle: *mut FileWriterHandle,
+) -> FileWriterError {
+    json_step(handle, |state| {
+        let text: &[u8] = if state.end_object()? { b"}\n" } else { b"}" };
+        state.push(text);
+        Ok(())
+    })
+}
+
+/// Writes the key of the next member of the innermost object. `key` is
+/// `size` bytes of UTF-8 and is escaped as needed.
+///
+/// # Safety
+/// - `handle` must be a valid FileWriterHandle pointer
+/// - `key` must be valid for reads of `size` bytes
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_json_key(
+    handle: *mut FileWriterHandle,
+    key: *const c_char,
+    size: usize,
+) -> FileWriterError {
+    let key = match unsafe { bytes_arg(key, size) } {
+        Some(k) => k,
+        None => return FileWriterError::InvalidData,
+    };
+    json_step(handle, |state| {
+        let separator = state.begin_key()?;
+        state.push(separator);
+        state.push_string(key);
+        state.push(b":");
+        Ok(())
+    })
+}
+
+/// Writes a string value: `size` bytes of UTF-8, escaped as needed. Runs
+/// with nothing to escape, usually the whole string, are copied in bulk.
+///
+/// # Safety
+/// - `handle` must be a valid FileWriterHandle pointer
+/// - `value` must be valid for reads of `size` bytes
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_json_string(
+    handle: *mut FileWriterHandle,
+    value: *const c_char,
+    size: usize,
+) -> FileWriterError {
+    let value = match unsafe { bytes_arg(value, size) } {
+        Some(v) => v,
+        None => return FileWriterError::InvalidData,
+    };
+    json_step(handle, |state| {
+        state.begin_value()?;
+        state.push_string(value);
+        Ok(())
+    })
+}
+
+/// # Safety
+/// - `handle` must be a valid FileWriterHandle pointer
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_json_i64(
+    handle: *mut FileWriterHandle,
+    value: i64,
+) -> FileWriterError {
+    let mut buf = itoa::Buffer::new();
+    json_scalar(handle, buf.format(value))
+}
+
+/// # Safety
+/// - `handle` must be a valid FileWriterHandle pointer
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_json_u64(
+    handle: *mut FileWriterHandle,
+    value: u64,
+) -> FileWriterError {
+    let mut buf = itoa::Buffer::new();
+    json_scalar(handle, buf.format(value))
+}
+
+/// Writes a number value in shortest round-trip form. JSON has no NaN or
+/// infinity, so those return `InvalidData`.
+///
+/// # Safety
+/// - `handle` must be a valid FileWriterHandle pointer
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_json_f64(
+    handle: *mut FileWriterHandle,
+    value: f64,
+) -> FileWriterError {
+    if !value.is_finite() {
+        return FileWriterError::InvalidData;
+    }
+    let mut buf = ryu::Buffer::new();
+    json_scalar(handle, buf.format_finite(value))
+}
+
+/// # Safety
+/// - `handle` must be a valid FileWriterHandle pointer
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_json_bool(
+    handle: *mut FileWriterHandle,
+    value: bool,
+) -> FileWriterError {
+    json_scalar(handle, if value { "true" } else { "false" })
+}
+
+/// Drops the JSON line being built, if any, so that the next
+/// `file_writer_json_begin_object` starts a new one. None of it has been
+/// written.
+///
+/// # Safety
+/// - `handle` must be a valid FileWriterHandle pointer
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_json_abort(handle: *mut FileWriterHandle) -> FileWriterError {
+    match unsafe { handle.as_mut() } {
+        Some(fw) if fw.is_valid => {
+            fw.json.reset();
+            FileWriterError::Success
+        }
+        _ => FileWriterError::InvalidHandle,
+    }
+}
+
+/// # Safety
+/// - `handle` must be a valid FileWriterHandle pointer
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_close(handle: *mut FileWriterHandle) -> FileWriterError {
+    unsafe { close_handle(handle) }.0
+}
+
+/// Closes the handle like `file_writer_close` and stores the digest of the
+/// bytes this handle wrote to the file (see `FileWriterOptions::digest`) in
+/// `digest`, setting `digest_len` to its size: 16 for xxHash3-128
+/// (big-endian), 32 for BLAKE3, or 0 if the handle computes no digest or
+/// closing failed. That is the digest of the whole file unless the handle
+/// was opened with `FileWriterMode::Append`, whose digest leaves out the
+/// bytes that were already there.
+///
+/// # Safety
+/// - `handle` must be a valid FileWriterHandle pointer
+/// - `digest` must point to at least `FILE_WRITER_DIGEST_MAX_SIZE` writable bytes
+/// - `digest_len` must be a valid pointer to store the result
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_close_digest(
+    handle: *mut FileWriterHandle,
+    digest: *mut u8,
+    digest_len: *mut usize,
+) -> FileWriterError {
+    if digest.is_null() || digest_len.is_null() {
+        return FileWriterError::InvalidData;
+    }
+    unsafe { *digest_len = 0 };
+
+    let (result, value) = unsafe { close_handle(handle) };
+    if let Some(value) = value {
+        unsafe {
+            std::ptr::copy_nonoverlapping(value.as_ptr(), digest, value.len());
+            *digest_len = value.len();
+        }
+    }
+    result
+}
+
+unsafe fn close_handle(handle: *mut FileWriterHandle) -> (FileWriterError, Option<Vec<u8>>) {
+    if handle.is_null() {
+        return (FileWriterError::InvalidHandle, None);
+    }
+
+    let file_writer = *unsafe { Box::from_raw(handle) };
+    if !file_writer.is_valid {
+        return (FileWriterError::InvalidHandle, None);
+    }
+
+    // `into_inner` only empties the buffer; `finish` also ends the codec's
+    // last frame.
+    let closed = file_writer
+        .writer
+        .into_inner()
+        .and_then(Sink::finish_with_digest);
+    let rotation_finished = file_writer.rotation.is_none_or(|r| r.finish().is_ok());
+    match closed {
+        Ok((_, digest)) if rotation_finished => (FileWriterError::Success, digest),
+        _ => (FileWriterError::FileCloseError, None),
+    }
+}
+
+/// Reads `size` bytes of decompressed data starting at `offset` from a
+/// closed `FileWriterCompression::ZstdSeekable` file into `buf`, using its
+/// seek table to decompress only the blocks that overlap the range. The
+/// number of bytes read, short only at the end of the data, is stored in
+/// `bytes_read`. A file without a seek table gives `InvalidData`.
+///
+/// # Safety
+/// - `path` must be a valid null-terminated C string
+/// - `buf` must point to writable memory of at least `size` bytes
+/// - `bytes_read` must be a valid pointer to store the result
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_read_range(
+    path: *const c_char,
+    offset: u64,
+    buf: *mut u8,
+    size: usize,
+    bytes_read: *mut usize,
+) -> FileWriterError {
+    let path = match c_str_arg(path) {
+        Some(p) => Path::new(p),
+        None => return FileWriterError::InvalidPath,
+    };
+    if bytes_read.is_null() || (buf.is_null() && size > 0) {
+        return FileWriterError::InvalidData;
+    }
+    unsafe { *bytes_read = 0 };
+    if size == 0 {
+        return FileWriterError::Success;
+    }
+
+    #[cfg(feature = "zstd")]
+    {
+        let buf = unsafe { slice::from_raw_parts_mut(buf, size) };
+        match read_seekable_range(path, offset, buf) {
+            Ok(n) => {
+                unsafe { *bytes_read = n };
+                FileWriterError::Success
+            }
+            Err(e) if e.kind() == ErrorKind::InvalidData => FileWriterError::InvalidData,
+            Err(e) => e.into(),
+        }
+    }
+    #[cfg(not(feature = "zstd"))]
+    {
+        let _ = (path, offset);
+        FileWriterError::UnsupportedOption
+    }
+}
+
+/// Checks a file written with `FileWriterOptions::crc_block_size` set to
+/// `block_size`, splitting the blocks across `threads` threads (0 = one per
+/// CPU, and never more than that). Returns `Success` if every block matches
+/// its CRC32C trailer, or `InvalidData` with the index of the first bad
+/// block in `bad_block`. `FileOpenError` means the file could not be
+/// opened, `IoError` that reading it failed.
+///
+/// # Safety
+/// - `path` must be a valid null-terminated C string
+/// - `bad_block` must be NULL or a valid pointer to store the result
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_verify(
+    path: *const c_char,
+    block_size: u32,
+    threads: u32,
+    bad_block: *mut u64,
+) -> FileWriterError {
+    let path = match c_str_arg(path) {
+        Some(p) => Path::new(p),
+        None => return FileWriterError::InvalidPath,
+    };
+    if block_size == 0 {
+        return FileWriterError::InvalidData;
+    }
+    let threads = match threads {
+        0 => usize::MAX,
+        n => n as usize,
+    };
+    let file = match std::fs::File::open(path) {
+        Ok(f) => f,
+        Err(_) => return FileWriterError::FileOpenError,
+    };
+
+    match integrity::verify_crc_file(&file, block_size as usize, threads) {
+        Ok(None) => FileWriterError::Success,
+        Ok(Some(block)) => {
+            if let Some(out) = unsafe { bad_block.as_mut() } {
+                *out = block;
+            }
+            FileWriterError::InvalidData
+        }
+        Err(_) => FileWriterError::IoError,
+    }
+}
+
+#[cfg(unix)]
+pub type FileWriterRecorder = FlightRecorder;
+
+/// Opens a fixed-size circular "flight recorder" file of `capacity` data
+/// bytes plus a 64-byte header. The file is preallocated and memory-mapped;
+/// writes are copied straight into the mapping and wrap around to overwrite
+/// the oldest data, so they survive a process crash without any flush. An
+/// existing recorder of the same capacity is continued, anything else at
+/// `path` is replaced.
+///
+/// # Safety
+/// - `path` must be a valid null-terminated C string
+/// - `handle` must be a valid pointer to store the result
+#[cfg(unix)]
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_recorder_new(
+    path: *const c_char,
+    capacity: u64,
+    handle: *mut *mut FileWriterRecorder,
+) -> FileWriterError {
+    if handle.is_null() {
+        return FileWriterError::InvalidHandle;
+    }
+    unsafe { *handle = null_mut() };
+
+    let path = match c_str_arg(path) {
+        Some(p) => Path::new(p),
+        None => return FileWriterError::InvalidPath,
+    };
+    if capacity == 0 {
+        return FileWriterError::InvalidData;
+    }
+
+    match FlightRecorder::open(path, capacity) {
+        Ok(recorder) => {
+            unsafe { *handle = Box::into_raw(Box::new(recorder)) };
+            FileWriterError::Success
+        }
+        Err(e) if e.kind() == ErrorKind::InvalidInput => FileWriterError::InvalidData,
+        Err(_) => FileWriterError::FileOpenError,
+    }
+}
+
+/// # Safety
+/// - `handle` must be a valid FileWriterRecorder pointer
+/// - `data` must point to valid memory of at least `size` bytes
+#[cfg(unix)]
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_recorder_write(
+    handle: *mut FileWriterRecorder,
+    data: *const u8,
+    size: usize,
+) -> FileWriterError {
+    if size == 0 {
+        return FileWriterError::Success;
+    }
+    if data.is_null() {
+        return FileWriterError::InvalidData;
+    }
+
+    let recorder = match unsafe { handle.as_mut() } {
+        Some(r) => r,
+        None => return FileWriterError::InvalidHandle,
+    };
+
+    recorder.write(unsafe { slice::from_raw_parts(data, size) });
+    FileWriterError::Success
+}
+
+/// Writes the recorder's pages back to disk, for power-loss durability.
+///
+/// # Safety
+/// - `handle` must be a valid FileWriterRecorder pointer
+#[cfg(unix)]
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_recorder_sync(
+    handle: *mut FileWriterRecorder,
+) -> FileWriterError {
+    let recorder = match unsafe { handle.as_ref() } {
+        Some(r) => r,
+        None => return FileWriterError::InvalidHandle,
+    };
+
+    match recorder.sync() {
+        Ok(_) => FileWriterError::Success,
+        Err(_) => FileWriterError::IoError,
+    }
+}
+
+/// # Safety
+/// - `handle` must be a valid FileWriterRecorder pointer
+#[cfg(unix)]
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_recorder_close(
+    handle: *mut FileWriterRecorder,
+) -> FileWriterError {
+    if handle.is_null() {
+        return FileWriterError::InvalidHandle;
+    }
+    drop(unsafe { Box::from_raw(handle) });
+    FileWriterError::Success
+}
+
+/// Reconstructs the data retained in the recorder file at `src_path`, oldest
+/// byte first, into a regular file at `dst_path`.
+///
+/// # Safety
+/// - `src_path` and `dst_path` must be valid null-terminated C strings
+#[cfg(unix)]
+#[no_mangle]
+pub unsafe extern "C" fn file_writer_recorder_dump(
+    src_path: *const c_char,
+    dst_path: *const c_char,
+) -> FileWriterError {
+    let (src, dst) = match (c_str_arg(src_path), c_str_arg(dst_path)) {
+        (Some(s), Some(d)) => (s, d),
+        _ => return FileWriterError::InvalidPath,
+    };
+
+    let data = match read_recorder(Path::new(src)) {
+        Ok(d) => d,
+        Err(e) if e.kind() == ErrorKind::InvalidData => return FileWriterError::InvalidData,
+        Err(_) => return FileWriterError::FileOpenError,
+    };
+    match std::fs::write(dst, data) {
+        Ok(_) => FileWriterError::Success,
+        Err(_) => FileWriterError::FileWriteError,
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::ffi::CString;
+    use std::time::{Duration, Instant};
+    use tempfile::TempDir;
+
+    /// Waits for a rotating handle's next file, so that the next rollover
+    /// switches files instead of staying on the current one.
+    fn wait_prepared(handle: *mut FileWriterHandle) {
+        let rotation = unsafe { (*handle).rotation.as_ref() }.unwrap();
+        assert!(rotation.wait_prepared(Duration::from_secs(10)));
+    }
+
+    /// Sleeps until just after the next whole second of wall-clock time, so
+    /// 1-second rotation periods are crossed exactly once.
+    fn sleep_into_next_second() {
+        let now = std::time::SystemTime::now()
+            .duration_since(std::time::UNIX_EPOCH)
+            .unwrap();
+        std::thread::sleep(Duration::from_millis(1100 - now.subsec_millis() as u64));
+    }
+
+    /// Holds up one background worker until the returned receiver is read.
+    fn block_worker(open_worker: bool) -> std::sync::mpsc::Receiver<()> {
+        let (done, release) = std::sync::mpsc::sync_channel(0);
+        background::submit(background::Job::Barrier { open_worker, done });
+        release
+    }
+
+    #[test]
+    fn test_create_directories() {
+        // Create a temporary directory that will be automatically cleaned up
+        let temp_dir = TempDir::new().expect("Failed to create temp dir");
+        let base_path = temp_dir.path();
+
+        // Create a path with non-existent subdirectories
         let subdir_path = base_path.join("a/b/c");
         let file_path = subdir_path.join("test.txt");
 
-        // Convert path to C string
-        let c_path =
-            CString::new(file_path.to_string_lossy().as_bytes()).expect("Failed to create CString");
+        // Convert path to C string
+        let c_path =
+            CString::new(file_path.to_string_lossy().as_bytes()).expect("Failed to create CString");
+
+        let mut handle: *mut FileWriterHandle = std::ptr::null_mut();
+        let handle_ptr: *mut *mut FileWriterHandle = &mut handle;
+
+        // Call the function being tested
+        unsafe {
+            let result = file_writer_new(c_path.as_ptr(), handle_ptr, FileWriterMode::Write);
+
+            // Verify success
+            assert_eq!(result, FileWriterError::Success);
+            assert!(!handle.is_null());
+
+            // Verify directories and file were created
+            assert!(subdir_path.exists());
+            assert!(file_path.exists());
+
+            // Clean up
+            file_writer_close(handle);
+        }
+
+        // Directory should still exist after closing the file
+        assert!(subdir_path.exists());
+    }
+
+    #[test]
+    fn test_segmented_rollover() {
+        let temp_dir = TempDir::new().expect("Failed to create temp dir");
+        let seg_dir = temp_dir.path().join("segments");
+        let c_dir = CString::new(seg_dir.to_string_lossy().as_bytes()).unwrap();
+        let c_template = CString::new("app-{}.log").unwrap();
+        let record = [b'x'; 10];
+
+        let mut handle: *mut FileWriterHandle = std::ptr::null_mut();
+        unsafe {
+            let result =
+                file_writer_new_segmented(c_dir.as_ptr(), c_template.as_ptr(), 100, &mut handle);
+            assert_eq!(result, FileWriterError::Success);
+
+            // 35 records of 10 bytes: three full segments and a half-full one.
+            for i in 0..35 {
+                if i % 10 == 0 {
+                    wait_prepared(handle);
+                }
+                let result = file_writer_write_raw(handle, record.as_ptr(), record.len());
+                assert_eq!(result, FileWriterError::Success);
+            }
+            assert_eq!(file_writer_close(handle), FileWriterError::Success);
+        }
+
+        let mut segments: Vec<_> = std::fs::read_dir(&seg_dir)
+            .unwrap()
+            .map(|e| e.unwrap().file_name().into_string().unwrap())
+            .collect();
+        segments.sort();
+        assert_eq!(
+            segments,
+            [
+                "app-000000.log",
+                "app-000001.log",
+                "app-000002.log",
+                "app-000003.log"
+            ]
+        );
+        let sizes: Vec<_> = segments
+            .iter()
+            .map(|s| std::fs::metadata(seg_dir.join(s)).unwrap().len())
+            .collect();
+        assert_eq!(sizes, [100, 100, 100, 50]);
+
+        // Reopening continues the numbering instead of overwriting.
+        unsafe {
+            let result =
+                file_writer_new_segmented(c_dir.as_ptr(), c_template.as_ptr(), 100, &mut handle);
+            assert_eq!(result, FileWriterError::Success);
+            file_writer_write_raw(handle, record.as_ptr(), record.len());
+            assert_eq!(file_writer_close(handle), FileWriterError::Success);
+        }
+        assert!(seg_dir.join("app-000004.log").exists());
+        assert!(!seg_dir.join("app-000005.log").exists());
+    }
+
+    #[test]
+    fn test_time_rotation() {
+        let temp_dir = TempDir::new().expect("Failed to create temp dir");
+        let c_dir = CString::new(temp_dir.path().to_string_lossy().as_bytes()).unwrap();
+        let c_pattern = CString::new("%Y%m%d/%H%M%S.log").unwrap();
+        let record = b"tick\n";
+
+        let mut handle: *mut FileWriterHandle = std::ptr::null_mut();
+        sleep_into_next_second();
+        unsafe {
+            let result =
+                file_writer_new_rotating(c_dir.as_ptr(), c_pattern.as_ptr(), 1, &mut handle);
+            assert_eq!(result, FileWriterError::Success);
+
+            file_writer_write_raw(handle, record.as_ptr(), record.len());
+            sleep_into_next_second();
+            wait_prepared(handle);
+            file_writer_write_raw(handle, record.as_ptr(), record.len());
+            assert_eq!(file_writer_close(handle), FileWriterError::Success);
+        }
+
+        let day_dirs: Vec<_> = std::fs::read_dir(temp_dir.path())
+            .unwrap()
+            .map(|e| e.unwrap().path())
+            .collect();
+        let files: Vec<_> = day_dirs
+            .iter()
+            .flat_map(|d| std::fs::read_dir(d).unwrap())
+            .map(|e| e.unwrap().path())
+            .collect();
+        // One file per period, no leftover prepared file.
+        assert_eq!(files.len(), 2, "{files:?}");
+        for file in files {
+            assert_eq!(std::fs::read(file).unwrap(), record);
+        }
+    }
+
+    #[test]
+    fn test_time_rotation_does_not_wait_for_the_worker() {
+        let temp_dir = TempDir::new().expect("Failed to create temp dir");
+        let c_dir = CString::new(temp_dir.path().to_string_lossy().as_bytes()).unwrap();
+        let c_pattern = CString::new("%H%M%S.log").unwrap();
+        let record = b"tick\n";
+        let files = || std::fs::read_dir(temp_dir.path()).unwrap().count();
+
+        let mut handle: *mut FileWriterHandle = std::ptr::null_mut();
+        sleep_into_next_second();
+        unsafe {
+            let result =
+                file_writer_new_rotating(c_dir.as_ptr(), c_pattern.as_ptr(), 1, &mut handle);
+            assert_eq!(result, FileWriterError::Success);
+            file_writer_write_raw(handle, record.as_ptr(), record.len());
+
+            // Once the next file is prepared, keep the worker that closes
+            // files busy past the boundary: the switch must happen anyway.
+            wait_prepared(handle);
+            assert_eq!(files(), 2);
+            let release = block_worker(false);
+            sleep_into_next_second();
+            file_writer_write_raw(handle, record.as_ptr(), record.len());
+            release.recv().unwrap();
+            assert_eq!(file_writer_close(handle), FileWriterError::Success);
+        }
+
+        let written: Vec<_> = std::fs::read_dir(temp_dir.path())
+            .unwrap()
+            .map(|e| std::fs::read(e.unwrap().path()).unwrap())
+            .filter(|content| !content.is_empty())
+            .collect();
+        assert_eq!(written, [record, record]);
+    }
+
+    #[test]
+    fn test_rollover_does_not_wait_for_the_next_file() {
+        let temp_dir = TempDir::new().expect("Failed to create temp dir");
+        let c_dir = CString::new(temp_dir.path().to_string_lossy().as_bytes()).unwrap();
+        let c_template = CString::new("{}.seg").unwrap();
+        let record = [b'x'; 10];
+        let size = |name: &str| std::fs::metadata(temp_dir.path().join(name)).unwrap().len();
+
+        let mut handle: *mut FileWriterHandle = std::ptr::null_mut();
+        unsafe {
+            let result =
+                file_writer_new_segmented(c_dir.as_ptr(), c_template.as_ptr(), 100, &mut handle);
+            assert_eq!(result, FileWriterError::Success);
+            wait_prepared(handle);
+
+            // Segment 1 is ready, segment 2 cannot be opened until released:
+            // segment 1 takes the overflow instead of the writer waiting.
+            let release = block_worker(true);
+            let releaser = std::thread::spawn(move || {
+                std::thread::sleep(Duration::from_secs(2));
+                release.recv().unwrap();
+            });
+            let start = Instant::now();
+            for _ in 0..25 {
+                let result = file_writer_write_raw(handle, record.as_ptr(), record.len());
+                assert_eq!(result, FileWriterError::Success);
+            }
+            assert!(start.elapsed() < Duration::from_secs(1));
+
+            releaser.join().unwrap();
+            wait_prepared(handle);
+            file_writer_write_raw(handle, record.as_ptr(), record.len());
+            assert_eq!(file_writer_close(handle), FileWriterError::Success);
+        }
+
+        assert_eq!(size("000000.seg"), 100);
+        assert_eq!(size("000001.seg"), 150);
+        assert_eq!(size("000002.seg"), 10);
+    }
+
+    #[test]
+    fn test_opens_do_not_wait_for_closes() {
+        let temp_dir = TempDir::new().expect("Failed to create temp dir");
+        let c_dir = CString::new(temp_dir.path().to_string_lossy().as_bytes()).unwrap();
+        let c_template = CString::new("{}.seg").unwrap();
+        let record = [b'x'; 100];
 
         let mut handle: *mut FileWriterHandle = std::ptr::null_mut();
-        let handle_ptr: *mut *mut FileWriterHandle = &mut handle;
+        unsafe {
+            let result =
+                file_writer_new_segmented(c_dir.as_ptr(), c_template.as_ptr(), 100, &mut handle);
+            assert_eq!(result, FileWriterError::Success);
 
-        // Call the function being tested
+            // As if other handles' closes were slow: the next segments are
+            // still opened, so every write after the first switches files.
+            let release = block_worker(false);
+            for _ in 0..4 {
+                wait_prepared(handle);
+                file_writer_write_raw(handle, record.as_ptr(), record.len());
+            }
+            release.recv().unwrap();
+            assert_eq!(file_writer_close(handle), FileWriterError::Success);
+        }
+
+        let mut sizes: Vec<_> = std::fs::read_dir(temp_dir.path())
+            .unwrap()
+            .map(|e| e.unwrap().metadata().unwrap().len())
+            .collect();
+        sizes.sort();
+        assert_eq!(sizes, [100; 4]);
+    }
+
+    #[test]
+    fn test_close_does_not_wait_for_other_handles() {
+        let temp_dir = TempDir::new().expect("Failed to create temp dir");
+        let c_dir = CString::new(temp_dir.path().to_string_lossy().as_bytes()).unwrap();
+        let c_template = CString::new("{}.seg").unwrap();
+
+        // Jobs queued by other handles, stuck until released.
+        let releasers: Vec<_> = [true, false]
+            .map(|open_worker| {
+                let release = block_worker(open_worker);
+                std::thread::spawn(move || {
+                    std::thread::sleep(Duration::from_secs(2));
+                    release.recv().unwrap();
+                })
+            })
+            .into_iter()
+            .collect();
+
+        let mut handle: *mut FileWriterHandle = std::ptr::null_mut();
+        let start = Instant::now();
         unsafe {
-            let result = file_writer_new(c_path.as_ptr(), handle_ptr, FileWriterMode::Write);
+            let result =
+                file_writer_new_segmented(c_dir.as_ptr(), c_template.as_ptr(), 100, &mut handle);
+            assert_eq!(result, FileWriterError::Success);
+            file_writer_write_raw(handle, b"x".as_ptr(), 1);
+            assert_eq!(file_writer_close(handle), FileWriterError::Success);
+        }
+        assert!(start.elapsed() < Duration::from_secs(1));
 
-            // Verify success
+        for releaser in releasers {
+            releaser.join().unwrap();
+        }
+        let names: Vec<_> = std::fs::read_dir(temp_dir.path())
+            .unwrap()
+            .map(|e| e.unwrap().file_name())
+            .collect();
+        assert_eq!(names, ["000000.seg"]);
+    }
+
+    #[test]
+    fn test_retention_keeps_newest_segments() {
+        let temp_dir = TempDir::new().expect("Failed to create temp dir");
+        let seg_dir = temp_dir.path();
+        let c_dir = CString::new(seg_dir.to_string_lossy().as_bytes()).unwrap();
+        let c_template = CString::new("{}.seg").unwrap();
+        let record = [b'r'; 100];
+
+        let mut handle: *mut FileWriterHandle = std::ptr::null_mut();
+        unsafe {
+            let result =
+                file_writer_new_segmented(c_dir.as_ptr(), c_template.as_ptr(), 100, &mut handle);
             assert_eq!(result, FileWriterError::Success);
-            assert!(!handle.is_null());
+            assert_eq!(
+                file_writer_set_retention(handle, 3, 0, 0),
+                FileWriterError::Success
+            );
 
-            // Verify directories and file were created
-            assert!(subdir_path.exists());
-            assert!(file_path.exists());
+            for _ in 0..10 {
+                wait_prepared(handle);
+                file_writer_write_raw(handle, record.as_ptr(), record.len());
+            }
+            assert_eq!(file_writer_close(handle), FileWriterError::Success);
+        }
 
-            // Clean up
+        let mut segments: Vec<_> = std::fs::read_dir(seg_dir)
+            .unwrap()
+            .map(|e| e.unwrap().file_name().into_string().unwrap())
+            .collect();
+        segments.sort();
+        assert_eq!(segments, ["000007.seg", "000008.seg", "000009.seg"]);
+
+        // Plain handles have nothing to rotate.
+        let c_path = CString::new(seg_dir.join("plain.txt").to_string_lossy().as_bytes()).unwrap();
+        unsafe {
+            file_writer_new(c_path.as_ptr(), &mut handle, FileWriterMode::Write);
+            assert_eq!(
+                file_writer_set_retention(handle, 3, 0, 0),
+                FileWriterError::InvalidHandle
+            );
             file_writer_close(handle);
         }
+    }
 
-        // Directory should still exist after closing the file
-        assert!(subdir_path.exists());
+    #[cfg(feature = "zstd")]
+    #[test]
+    fn test_zstd_frames_on_flush_and_close() {
+        let temp_dir = TempDir::new().expect("Failed to create temp dir");
+        let path = temp_dir.path().join("log.zst");
+        let c_path = CString::new(path.to_string_lossy().as_bytes()).unwrap();
+        let options = FileWriterOptions {
+            compression: FileWriterCompression::Zstd as u32,
+            compression_level: 3,
+            compression_threads: 0,
+            ..Default::default()
+        };
+        let line = b"2024-01-01T00:00:00Z INFO request served in 12ms\n";
+
+        let mut handle: *mut FileWriterHandle = std::ptr::null_mut();
+        let mut expected = Vec::new();
+        unsafe {
+            let result = file_writer_new_with_options(
+                c_path.as_ptr(),
+                &mut handle,
+                FileWriterMode::Write,
+                &options,
+            );
+            assert_eq!(result, FileWriterError::Success);
+
+            for _ in 0..1000 {
+                file_writer_write_raw(handle, line.as_ptr(), line.len());
+                expected.extend_from_slice(line);
+            }
+            assert_eq!(file_writer_flush(handle), FileWriterError::Success);
+            // A flushed file is complete on its own.
+            let flushed = std::fs::read(&path).unwrap();
+            assert!(flushed.len() < expected.len() / 10);
+            assert_eq!(zstd::decode_all(&flushed[..]).unwrap(), expected);
+
+            let large = vec![b'z'; 2 * 1024 * 1024];
+            for _ in 0..2 {
+                file_writer_write_large(handle, large.as_ptr(), large.len());
+                expected.extend_from_slice(&large);
+            }
+            assert_eq!(file_writer_close(handle), FileWriterError::Success);
+        }
+
+        let compressed = std::fs::read(&path).unwrap();
+        assert_eq!(zstd::decode_all(&compressed[..]).unwrap(), expected);
+        // One frame ended by the flush, one by the close: large writes do
+        // not end frames of their own.
+        let frames = compressed
+            .windows(4)
+            .filter(|w| *w == [0x28, 0xB5, 0x2F, 0xFD])
+            .count();
+        assert_eq!(frames, 2);
+    }
+
+    #[cfg(not(feature = "zstd"))]
+    #[test]
+    fn test_compression_needs_feature() {
+        let temp_dir = TempDir::new().expect("Failed to create temp dir");
+        let c_path =
+            CString::new(temp_dir.path().join("log.zst").to_string_lossy().as_bytes()).unwrap();
+        let options = FileWriterOptions {
+            compression: FileWriterCompression::Zstd as u32,
+            compression_level: 0,
+            compression_threads: 0,
+            ..Default::default()
+        };
+
+        let mut handle: *mut FileWriterHandle = std::ptr::null_mut();
+        let result = unsafe {
+            file_writer_new_with_options(
+                c_path.as_ptr(),
+                &mut handle,
+                FileWriterMode::Write,
+                &options,
+            )
+        };
+        assert_eq!(result, FileWriterError::UnsupportedOption);
+        assert!(handle.is_null());
+    }
+
+    #[test]
+    fn test_options_reject_unknown_values() {
+        let temp_dir = TempDir::new().expect("Failed to create temp dir");
+        let c_path =
+            CString::new(temp_dir.path().join("out.bin").to_string_lossy().as_bytes()).unwrap();
+
+        for options in [
+            FileWriterOptions {
+                compression: 4,
+                ..Default::default()
+            },
+            FileWriterOptions {
+                digest: u32::MAX,
+                ..Default::default()
+            },
+        ] {
+            let mut handle: *mut FileWriterHandle = std::ptr::null_mut();
+            let result = unsafe {
+                file_writer_new_with_options(
+                    c_path.as_ptr(),
+                    &mut handle,
+                    FileWriterMode::Write,
+                    &options,
+                )
+            };
+            assert_eq!(result, FileWriterError::InvalidData);
+            assert!(handle.is_null());
+        }
+    }
+
+    #[test]
+    fn test_seekable_rejects_append_and_crc() {
+        let temp_dir = TempDir::new().expect("Failed to create temp dir");
+        let c_path =
+            CString::new(temp_dir.path().join("log.zst").to_string_lossy().as_bytes()).unwrap();
+        let seekable = FileWriterOptions {
+            compression: FileWriterCompression::ZstdSeekable as u32,
+            ..Default::default()
+        };
+        let with_crc = FileWriterOptions {
+            crc_block_size: 4096,
+            ..seekable
+        };
+
+        for (mode, options) in [
+            (FileWriterMode::Append, seekable),
+            (FileWriterMode::Write, with_crc),
+        ] {
+            let mut handle: *mut FileWriterHandle = std::ptr::null_mut();
+            let result = unsafe {
+                file_writer_new_with_options(c_path.as_ptr(), &mut handle, mode, &options)
+            };
+            assert_eq!(result, FileWriterError::InvalidData);
+            assert!(handle.is_null());
+        }
+    }
+
+    #[test]
+    fn test_crc_blocks_reject_append() {
+        let temp_dir = TempDir::new().expect("Failed to create temp dir");
+        let path = temp_dir.path().join("log.bin");
+        let c_path = CString::new(path.to_string_lossy().as_bytes()).unwrap();
+        std::fs::write(&path, b"existing").unwrap();
+        let options = FileWriterOptions {
+            crc_block_size: 4096,
+            ..Default::default()
+        };
+
+        let mut handle: *mut FileWriterHandle = std::ptr::null_mut();
+        let result = unsafe {
+            file_writer_new_with_options(
+                c_path.as_ptr(),
+                &mut handle,
+                FileWriterMode::Append,
+                &options,
+            )
+        };
+        assert_eq!(result, FileWriterError::InvalidData);
+        assert!(handle.is_null());
+        assert_eq!(std::fs::read(&path).unwrap(), b"existing");
+    }
+
+    #[cfg(feature = "zstd")]
+    #[test]
+    fn test_seekable_range_reads() {
+        let temp_dir = TempDir::new().expect("Failed to create temp dir");
+        let path = temp_dir.path().join("log.zst");
+        let c_path = CString::new(path.to_string_lossy().as_bytes()).unwrap();
+        let options = FileWriterOptions {
+            compression: FileWriterCompression::ZstdSeekable as u32,
+            compression_level: 1,
+            compression_threads: 2,
+            ..Default::default()
+        };
+        let data: Vec<u8> = (0..3_500_000u32)
+            .map(|i| (i / 1000) as u8 ^ i as u8)
+            .collect();
+
+        let mut handle: *mut FileWriterHandle = std::ptr::null_mut();
+        unsafe {
+            let result = file_writer_new_with_options(
+                c_path.as_ptr(),
+                &mut handle,
+                FileWriterMode::Write,
+                &options,
+            );
+            assert_eq!(result, FileWriterError::Success);
+            file_writer_write_raw(handle, data.as_ptr(), 1_000_000);
+            // A flush in the middle gives a short block; the index copes.
+            file_writer_flush(handle);
+            file_writer_write_raw(handle, data[1_000_000..].as_ptr(), data.len() - 1_000_000);
+            assert_eq!(file_writer_close(handle), FileWriterError::Success);
+        }
+
+        // Still an ordinary zstd stream as a whole.
+        let compressed = std::fs::read(&path).unwrap();
+        assert_eq!(zstd::decode_all(&compressed[..]).unwrap(), data);
+
+        let mut buf = vec![0u8; 300_000];
+        let mut read = 0;
+        for offset in [0u64, 999_900, 2_000_000, 3_400_000] {
+            let result = unsafe {
+                file_writer_read_range(
+                    c_path.as_ptr(),
+                    offset,
+                    buf.as_mut_ptr(),
+                    buf.len(),
+                    &mut read,
+                )
+            };
+            assert_eq!(result, FileWriterError::Success);
+            let end = (offset as usize + buf.len()).min(data.len());
+            assert_eq!(read, end - offset as usize);
+            assert_eq!(buf[..read], data[offset as usize..end]);
+        }
+    }
+
+    #[cfg(feature = "lz4")]
+    #[test]
+    fn test_lz4_frames_round_trip() {
+        use std::io::Read;
+
+        let temp_dir = TempDir::new().expect("Failed to create temp dir");
+        let path = temp_dir.path().join("log.lz4");
+        let c_path = CString::new(path.to_string_lossy().as_bytes()).unwrap();
+        let options = FileWriterOptions {
+            compression: FileWriterCompression::Lz4 as u32,
+            ..Default::default()
+        };
+        let line = b"2024-01-01T00:00:00Z INFO request served in 12ms\n";
+
+        let mut handle: *mut FileWriterHandle = std::ptr::null_mut();
+        let mut expected = Vec::new();
+        unsafe {
+            let result = file_writer_new_with_options(
+                c_path.as_ptr(),
+                &mut handle,
+                FileWriterMode::Write,
+                &options,
+            );
+            assert_eq!(result, FileWriterError::Success);
+            for i in 0..20_000 {
+                file_writer_write_raw(handle, line.as_ptr(), line.len());
+                expected.extend_from_slice(line);
+                if i == 10_000 {
+                    file_writer_flush(handle);
+                }
+            }
+            assert_eq!(file_writer_close(handle), FileWriterError::Success);
+        }
+
+        let compressed = std::fs::read(&path).unwrap();
+        let mut decoded = Vec::new();
+        lz4_flex::frame::FrameDecoder::new(&compressed[..])
+            .read_to_end(&mut decoded)
+            .unwrap();
+        assert_eq!(decoded, expected);
+    }
+
+    #[test]
+    fn test_crc_blocks_verify_and_catch_corruption() {
+        let temp_dir = TempDir::new().expect("Failed to create temp dir");
+        let path = temp_dir.path().join("data.crc");
+        let c_path = CString::new(path.to_string_lossy().as_bytes()).unwrap();
+        let options = FileWriterOptions {
+            crc_block_size: 4096,
+            ..Default::default()
+        };
+        let data: Vec<u8> = (0..100_000u32).map(|i| (i % 251) as u8).collect();
+
+        let mut handle: *mut FileWriterHandle = std::ptr::null_mut();
+        unsafe {
+            let result = file_writer_new_with_options(
+                c_path.as_ptr(),
+                &mut handle,
+                FileWriterMode::Write,
+                &options,
+            );
+            assert_eq!(result, FileWriterError::Success);
+            file_writer_write_raw(handle, data.as_ptr(), 10_000);
+            file_writer_flush(handle);
+            file_writer_write_large(handle, data[10_000..].as_ptr(), data.len() - 10_000);
+            assert_eq!(file_writer_close(handle), FileWriterError::Success);
+        }
+
+        // 24 full blocks and a short one, each with a trailer.
+        let mut stored = std::fs::read(&path).unwrap();
+        assert_eq!(stored.len(), data.len() + 25 * 4);
+        let payload: Vec<u8> = stored
+            .chunks(4100)
+            .flat_map(|c| &c[..c.len() - 4])
+            .copied()
+            .collect();
+        assert_eq!(payload, data);
+
+        let mut bad_block = u64::MAX;
+        for threads in [1, 3, 0, u32::MAX] {
+            let result =
+                unsafe { file_writer_verify(c_path.as_ptr(), 4096, threads, &mut bad_block) };
+            assert_eq!(result, FileWriterError::Success);
+        }
+
+        // Opening fails, then reading: a directory opens but cannot be read.
+        let missing =
+            CString::new(temp_dir.path().join("missing").to_string_lossy().as_bytes()).unwrap();
+        let result = unsafe { file_writer_verify(missing.as_ptr(), 4096, 1, &mut bad_block) };
+        assert_eq!(result, FileWriterError::FileOpenError);
+        #[cfg(unix)]
+        {
+            let dir = CString::new(temp_dir.path().to_string_lossy().as_bytes()).unwrap();
+            let result = unsafe { file_writer_verify(dir.as_ptr(), 16, 1, &mut bad_block) };
+            assert_eq!(result, FileWriterError::IoError);
+        }
+
+        stored[7 * 4100 + 17] ^= 1;
+        stored[20 * 4100 + 1] ^= 1;
+        std::fs::write(&path, &stored).unwrap();
+        let result = unsafe { file_writer_verify(c_path.as_ptr(), 4096, 4, &mut bad_block) };
+        assert_eq!(result, FileWriterError::InvalidData);
+        assert_eq!(bad_block, 7);
+    }
+
+    #[test]
+    fn test_close_returns_content_digest() {
+        use xxhash_rust::xxh3::xxh3_128;
+
+        let temp_dir = TempDir::new().expect("Failed to create temp dir");
+        let path = temp_dir.path().join("out.bin");
+        let c_path = CString::new(path.to_string_lossy().as_bytes()).unwrap();
+        let data: Vec<u8> = (0..300_000u32).map(|i| (i % 253) as u8).collect();
+
+        let mut digest = [0u8; FILE_WRITER_DIGEST_MAX_SIZE];
+        let mut digest_len = usize::MAX;
+        for crc_block_size in [0, 4096] {
+            let options = FileWriterOptions {
+                digest: FileWriterDigest::Xxh3_128 as u32,
+                crc_block_size,
+                ..Default::default()
+            };
+            let mut handle: *mut FileWriterHandle = std::ptr::null_mut();
+            unsafe {
+                let result = file_writer_new_with_options(
+                    c_path.as_ptr(),
+                    &mut handle,
+                    FileWriterMode::Write,
+                    &options,
+                );
+                assert_eq!(result, FileWriterError::Success);
+                file_writer_write_raw(handle, data.as_ptr(), 1000);
+                file_writer_write_large(handle, data[1000..].as_ptr(), data.len() - 1000);
+                let result = file_writer_close_digest(handle, digest.as_mut_ptr(), &mut digest_len);
+                assert_eq!(result, FileWriterError::Success);
+            }
+
+            // The digest is of the file as stored.
+            let stored = std::fs::read(&path).unwrap();
+            assert_eq!(digest_len, 16);
+            assert_eq!(digest[..16], xxh3_128(&stored).to_be_bytes());
+        }
+
+        // Appending: only the bytes this handle added.
+        let before = std::fs::read(&path).unwrap();
+        let options = FileWriterOptions {
+            digest: FileWriterDigest::Xxh3_128 as u32,
+            ..Default::default()
+        };
+        unsafe {
+            let mut handle: *mut FileWriterHandle = std::ptr::null_mut();
+            let result = file_writer_new_with_options(
+                c_path.as_ptr(),
+                &mut handle,
+                FileWriterMode::Append,
+                &options,
+            );
+            assert_eq!(result, FileWriterError::Success);
+            file_writer_write_raw(handle, data.as_ptr(), 5000);
+            let result = file_writer_close_digest(handle, digest.as_mut_ptr(), &mut digest_len);
+            assert_eq!(result, FileWriterError::Success);
+        }
+        let stored = std::fs::read(&path).unwrap();
+        assert_eq!(stored.len(), before.len() + 5000);
+        assert_eq!(digest[..16], xxh3_128(&data[..5000]).to_be_bytes());
+
+        // No digest requested: nothing returned.
+        unsafe {
+            let mut handle: *mut FileWriterHandle = std::ptr::null_mut();
+            file_writer_new(c_path.as_ptr(), &mut handle, FileWriterMode::Write);
+            let result = file_writer_close_digest(handle, digest.as_mut_ptr(), &mut digest_len);
+            assert_eq!(result, FileWriterError::Success);
+            assert_eq!(digest_len, 0);
+        }
+    }
+
+    #[test]
+    fn test_write_batch() {
+        let temp_dir = TempDir::new().expect("Failed to create temp dir");
+        let path = temp_dir.path().join("batch.txt");
+        let c_path = CString::new(path.to_string_lossy().as_bytes()).unwrap();
+        let parts = ["id=", "", "42", "\n"];
+        let mut batch: Vec<_> = parts
+            .iter()
+            .map(|p| BufferDescriptor {
+                data: p.as_ptr(),
+                size: p.len(),
+            })
+            .collect();
+        batch[1].data = std::ptr::null();
+
+        let mut handle: *mut FileWriterHandle = std::ptr::null_mut();
+        unsafe {
+            file_writer_new(c_path.as_ptr(), &mut handle, FileWriterMode::Write);
+            let result = file_writer_write_batch(handle, batch.as_ptr(), batch.len());
+            assert_eq!(result, FileWriterError::Success);
+
+            // A null buffer with a size is rejected before anything is written.
+            batch[1].size = 1;
+            let result = file_writer_write_batch(handle, batch.as_ptr(), batch.len());
+            assert_eq!(result, FileWriterError::InvalidData);
+            assert_eq!(file_writer_close(handle), FileWriterError::Success);
+        }
+
+        assert_eq!(std::fs::read_to_string(&path).unwrap(), "id=42\n");
+    }
+
+    #[test]
+    fn test_records_are_length_prefixed() {
+        let temp_dir = TempDir::new().expect("Failed to create temp dir");
+        let path = temp_dir.path().join("records.bin");
+        let c_path = CString::new(path.to_string_lossy().as_bytes()).unwrap();
+        let payloads: Vec<Vec<u8>> = [0usize, 1, 127, 128, 70_000]
+            .iter()
+            .map(|&n| vec![n as u8; n])
+            .collect();
+
+        let mut handle: *mut FileWriterHandle = std::ptr::null_mut();
+        unsafe {
+            file_writer_new(c_path.as_ptr(), &mut handle, FileWriterMode::Write);
+            for p in &payloads[..2] {
+                let result = file_writer_write_record(handle, p.as_ptr(), p.len());
+                assert_eq!(result, FileWriterError::Success);
+            }
+            let batch: Vec<_> = payloads[2..]
+                .iter()
+                .map(|p| BufferDescriptor {
+                    data: p.as_ptr(),
+                    size: p.len(),
+                })
+                .collect();
+            let result = file_writer_write_records(handle, batch.as_ptr(), batch.len());
+            assert_eq!(result, FileWriterError::Success);
+            assert_eq!(file_writer_close(handle), FileWriterError::Success);
+        }
+
+        let stored = std::fs::read(&path).unwrap();
+        let mut rest = &stored[..];
+        let mut decoded = Vec::new();
+        while !rest.is_empty() {
+            let (mut len, mut shift, mut i) = (0usize, 0, 0);
+            loop {
+                len |= ((rest[i] & 0x7F) as usize) << shift;
+                shift += 7;
+                i += 1;
+                if rest[i - 1] < 0x80 {
+                    break;
+                }
+            }
+            decoded.push(rest[i..i + len].to_vec());
+            rest = &rest[i + len..];
+        }
+        assert_eq!(decoded, payloads);
+    }
+
+    #[test]
+    fn test_numeric_writers() {
+        let temp_dir = TempDir::new().expect("Failed to create temp dir");
+        let path = temp_dir.path().join("numbers.csv");
+        let c_path = CString::new(path.to_string_lossy().as_bytes()).unwrap();
+        let comma = b",";
+
+        let mut handle: *mut FileWriterHandle = std::ptr::null_mut();
+        unsafe {
+            file_writer_new(c_path.as_ptr(), &mut handle, FileWriterMode::Write);
+            let writes: [&dyn Fn() -> FileWriterError; 8] = [
+                &|| file_writer_write_u64(handle, 0),
+                &|| file_writer_write_u64(handle, u64::MAX),
+                &|| file_writer_write_i64(handle, i64::MIN),
+                &|| file_writer_write_i64(handle, -42),
+                &|| file_writer_write_f64(handle, 0.1),
+                &|| file_writer_write_f64(handle, -1.5e-300),
+                &|| file_writer_write_f64(handle, 3.0),
+                &|| file_writer_write_f64(handle, f64::NAN),
+            ];
+            for write in writes {
+                assert_eq!(write(), FileWriterError::Success);
+                file_writer_write_raw(handle, comma.as_ptr(), comma.len());
+            }
+            assert_eq!(file_writer_close(handle), FileWriterError::Success);
+        }
+
+        assert_eq!(
+            std::fs::read_to_string(&path).unwrap(),
+            "0,18446744073709551615,-9223372036854775808,-42,0.1,-1.5e-300,3.0,NaN,"
+        );
+    }
+
+    #[test]
+    fn test_csv_rows() {
+        let temp_dir = TempDir::new().expect("Failed to create temp dir");
+        let path = temp_dir.path().join("rows.csv");
+        let c_path = CString::new(path.to_string_lossy().as_bytes()).unwrap();
+        let row = |fields: &[&str]| -> Vec<BufferDescriptor> {
+            fields
+                .iter()
+                .map(|f| BufferDescriptor {
+                    data: f.as_ptr(),
+                    size: f.len(),
+                })
+                .collect()
+        };
+
+        let mut handle: *mut FileWriterHandle = std::ptr::null_mut();
+        unsafe {
+            file_writer_new(c_path.as_ptr(), &mut handle, FileWriterMode::Write);
+            let fields = row(&["id", "name", "note"]);
+            assert_eq!(
+                file_writer_csv_row(handle, fields.as_ptr(), fields.len()),
+                FileWriterError::Success
+            );
+            let fields = row(&["1", "Smith, J", "said \"ok\""]);
+            file_writer_csv_row(handle, fields.as_ptr(), fields.len());
+
+            assert_eq!(
+                file_writer_csv_set_format(handle, b'\t' as c_char, b'"' as c_char),
+                FileWriterError::Success
+            );
+            let fields = row(&["2", "Smith, J", "a\tb"]);
+            file_writer_csv_row(handle, fields.as_ptr(), fields.len());
+            assert_eq!(
+                file_writer_csv_set_format(handle, b'\n' as c_char, b'"' as c_char),
+                FileWriterError::InvalidData
+            );
+            (*handle).is_valid = false;
+            assert_eq!(
+                file_writer_csv_set_format(handle, b';' as c_char, b'"' as c_char),
+                FileWriterError::InvalidHandle
+            );
+            (*handle).is_valid = true;
+            assert_eq!(file_writer_close(handle), FileWriterError::Success);
+        }
+
+        assert_eq!(
+            std::fs::read_to_string(&path).unwrap(),
+            "id,name,note\n1,\"Smith, J\",\"said \"\"ok\"\"\"\n2\tSmith, J\t\"a\tb\"\n"
+        );
+    }
+
+    #[test]
+    fn test_json_lines() {
+        let temp_dir = TempDir::new().expect("Failed to create temp dir");
+        let path = temp_dir.path().join("events.jsonl");
+        let c_path = CString::new(path.to_string_lossy().as_bytes()).unwrap();
+        let key =
+            |handle, k: &str| unsafe { file_writer_json_key(handle, k.as_ptr().cast(), k.len()) };
+        let string = |handle, v: &str| unsafe {
+            file_writer_json_string(handle, v.as_ptr().cast(), v.len())
+        };
+
+        let mut handle: *mut FileWriterHandle = std::ptr::null_mut();
+        unsafe {
+            file_writer_new(c_path.as_ptr(), &mut handle, FileWriterMode::Write);
+            for i in 0..2 {
+                assert_eq!(
+                    file_writer_json_begin_object(handle),
+                    FileWriterError::Success
+                );
+                key(handle, "id");
+                file_writer_json_u64(handle, i);
+                key(handle, "msg");
+                string(handle, "line \"one\"\n");
+                key(handle, "ctx");
+                file_writer_json_begin_object(handle);
+                key(handle, "ok");
+                file_writer_json_bool(handle, i == 0);
+                key(handle, "t");
+                file_writer_json_f64(handle, 0.5);
+                key(handle, "d");
+                file_writer_json_i64(handle, -3);
+                file_writer_json_end_object(handle);
+                assert_eq!(
+                    file_writer_json_end_object(handle),
+                    FileWriterError::Success
+                );
+            }
+            assert_eq!(
+                file_writer_json_bool(handle, true),
+                FileWriterError::InvalidData
+            );
+            assert_eq!(
+                file_writer_json_end_object(handle),
+                FileWriterError::InvalidData
+            );
+            file_writer_json_begin_object(handle);
+            key(handle, "x");
+            assert_eq!(
+                file_writer_json_f64(handle, f64::NAN),
+                FileWriterError::InvalidData
+            );
+            assert_eq!(
+                file_writer_json_end_object(handle),
+                FileWriterError::InvalidData
+            );
+            assert_eq!(file_writer_flush(handle), FileWriterError::Success);
+            assert_eq!(std::fs::read(&path).unwrap().len(), 131);
+
+            // Drop the unfinished line and write another.
+            assert_eq!(file_writer_json_abort(handle), FileWriterError::Success);
+            file_writer_json_begin_object(handle);
+            key(handle, "after");
+            file_writer_json_bool(handle, true);
+            file_writer_json_end_object(handle);
+
+            // An unfinished line left at close is dropped too.
+            file_writer_json_begin_object(handle);
+            key(handle, "lost");
+            assert_eq!(file_writer_close(handle), FileWriterError::Success);
+        }
+
+        assert_eq!(
+            std::fs::read_to_string(&path).unwrap(),
+            concat!(
+                r#"{"id":0,"msg":"line \"one\"\n","ctx":{"ok":true,"t":0.5,"d":-3}}"#,
+                "\n",
+                r#"{"id":1,"msg":"line \"one\"\n","ctx":{"ok":false,"t":0.5,"d":-3}}"#,
+                "\n",
+                r#"{"after":true}"#,
+                "\n",
+            )
+        );
+    }
+
+    #[test]
+    fn test_reserve_and_commit() {
+        let temp_dir = TempDir::new().expect("Failed to create temp dir");
+        let path = temp_dir.path().join("reserved.txt");
+        let c_path = CString::new(path.to_string_lossy().as_bytes()).unwrap();
+
+        let mut handle: *mut FileWriterHandle = std::ptr::null_mut();
+        let mut data: *mut u8 = std::ptr::null_mut();
+        let mut available = 0usize;
+        unsafe {
+            file_writer_new(c_path.as_ptr(), &mut handle, FileWriterMode::Write);
+            file_writer_set_buffer_size(handle, 16);
+            file_writer_write_string(handle, c"head ".as_ptr());
+
+            assert_eq!(
+                file_writer_reserve(handle, 8, &mut data, &mut available),
+                FileWriterError::Success
+            );
+            assert!(available >= 8);
+            std::ptr::copy_nonoverlapping(b"in place".as_ptr(), data, 8);
+            assert_eq!(file_writer_commit(handle, 8), FileWriterError::Success);
+
+            // Larger than the buffer: it grows until the commit, which writes
+            // the reservation out and shrinks it back.
+            file_writer_reserve(handle, 100, &mut data, &mut available);
+            assert!(available >= 100);
+            std::ptr::write_bytes(data, b'x', 100);
+            assert_eq!(file_writer_commit(handle, 100), FileWriterError::Success);
+            assert_eq!(std::fs::read(&path).unwrap().len(), 113);
+            let cursor = &*(handle as *const buffer::FileWriterCursor);
+            assert_eq!((cursor.pos, cursor.cap), (0, 16));
+            assert_eq!(
+                file_writer_commit(handle, usize::MAX),
+                FileWriterError::InvalidData
+            );
+            assert_eq!(file_writer_close(handle), FileWriterError::Success);
+        }
+
+        let expected = format!("head in place{}", "x".repeat(100));
+        assert_eq!(std::fs::read_to_string(&path).unwrap(), expected);
+    }
+
+    #[test]
+    fn test_reserve_counts_only_committed_bytes() {
+        let temp_dir = TempDir::new().expect("Failed to create temp dir");
+        let c_dir = CString::new(temp_dir.path().to_string_lossy().as_bytes()).unwrap();
+        let c_template = CString::new("{}.seg").unwrap();
+
+        let mut handle: *mut FileWriterHandle = std::ptr::null_mut();
+        let mut data: *mut u8 = std::ptr::null_mut();
+        let mut available = 0usize;
+        unsafe {
+            let result =
+                file_writer_new_segmented(c_dir.as_ptr(), c_template.as_ptr(), 100, &mut handle);
+            assert_eq!(result, FileWriterError::Success);
+            // Reservations far larger than what is committed, as printf makes.
+            for i in 0..15 {
+                if i % 10 == 0 {
+                    wait_prepared(handle);
+                }
+                file_writer_reserve(handle, 256, &mut data, &mut available);
+                std::ptr::write_bytes(data, b'0' + i, 10);
+                assert_eq!(file_writer_commit(handle, 10), FileWriterError::Success);
+            }
+            assert_eq!(file_writer_close(handle), FileWriterError::Success);
+        }
+
+        let read = |name: &str| std::fs::read(temp_dir.path().join(name)).unwrap();
+        let expected: Vec<u8> = (0..15).flat_map(|i| [b'0' + i; 10]).collect();
+        assert_eq!(read("000000.seg"), expected[..100]);
+        assert_eq!(read("000001.seg"), expected[100..]);
+    }
+
+    #[test]
+    fn test_submit_commands() {
+        let temp_dir = TempDir::new().expect("Failed to create temp dir");
+        let path = temp_dir.path().join("submit.bin");
+        let c_path = CString::new(path.to_string_lossy().as_bytes()).unwrap();
+
+        let command = |op: FileWriterOp, data: *const u8, value| FileWriterCommand {
+            op: op as u32,
+            data,
+            value,
+        };
+        let commands = [
+            command(FileWriterOp::WriteBytes, b"id=".as_ptr(), 3),
+            command(FileWriterOp::WriteU64, std::ptr::null(), 42),
+            command(FileWriterOp::WriteString, c" ok".as_ptr().cast(), 0),
+            command(FileWriterOp::Align, std::ptr::null(), 16),
+            command(FileWriterOp::Flush, std::ptr::null(), 0),
+            command(FileWriterOp::Align, std::ptr::null(), 16),
+            command(FileWriterOp::WriteBytes, std::ptr::null(), 0),
+            command(FileWriterOp::WriteBytes, b"end".as_ptr(), 3),
+        ];
+
+        let mut handle: *mut FileWriterHandle = std::ptr::null_mut();
+        unsafe {
+            file_writer_new(c_path.as_ptr(), &mut handle, FileWriterMode::Write);
+            assert_eq!(
+                file_writer_submit(handle, commands.as_ptr(), commands.len()),
+                FileWriterError::Success
+            );
+            assert_eq!(
+                std::fs::read(&path).unwrap(),
+                b"id=42 ok\0\0\0\0\0\0\0\0",
+                "flushed by the Flush command"
+            );
+
+            // Stops at the first failure, after running the ones before it.
+            let bad = [
+                command(FileWriterOp::WriteBytes, b"!".as_ptr(), 1),
+                command(FileWriterOp::Align, std::ptr::null(), 0),
+                command(FileWriterOp::WriteBytes, b"?".as_ptr(), 1),
+            ];
+            assert_eq!(
+                file_writer_submit(handle, bad.as_ptr(), bad.len()),
+                FileWriterError::InvalidData
+            );
+            assert_eq!(
+                file_writer_submit(handle, std::ptr::null(), 0),
+                FileWriterError::InvalidData
+            );
+            let unknown = [FileWriterCommand {
+                op: 5,
+                ..command(FileWriterOp::WriteBytes, b"?".as_ptr(), 1)
+            }];
+            assert_eq!(
+                file_writer_submit(handle, unknown.as_ptr(), unknown.len()),
+                FileWriterError::InvalidData
+            );
+            assert_eq!(file_writer_close(handle), FileWriterError::Success);
+            assert_eq!(
+                file_writer_submit(std::ptr::null_mut(), commands.as_ptr(), 1),
+                FileWriterError::InvalidHandle
+            );
+        }
+
+        assert_eq!(
+            std::fs::read(&path).unwrap(),
+            b"id=42 ok\0\0\0\0\0\0\0\0end!"
+        );
+    }
+
+    #[test]
+    fn test_handle_starts_with_inline_cursor() {
+        let temp_dir = TempDir::new().expect("Failed to create temp dir");
+        let path = temp_dir.path().join("inline.txt");
+        let c_path = CString::new(path.to_string_lossy().as_bytes()).unwrap();
+
+        let mut handle: *mut FileWriterHandle = std::ptr::null_mut();
+        unsafe {
+            file_writer_new(c_path.as_ptr(), &mut handle, FileWriterMode::Write);
+            file_writer_write_string(handle, c"rust ".as_ptr());
+
+            // What the header's file_writer_write_inline does.
+            let cursor = &mut *(handle as *mut buffer::FileWriterCursor);
+            assert_eq!(cursor.cap, 64 * 1024);
+            assert_eq!(cursor.pos, 5);
+            std::ptr::copy_nonoverlapping(b"inline".as_ptr(), cursor.data.add(cursor.pos), 6);
+            cursor.pos += 6;
+
+            file_writer_set_buffer_size(handle, 128);
+            let cursor = &*(handle as *const buffer::FileWriterCursor);
+            assert_eq!((cursor.pos, cursor.cap), (0, 128));
+            assert_eq!(file_writer_close(handle), FileWriterError::Success);
+
+            // Segmented handles count every write, so they never write inline.
+            let dir =
+                CString::new(temp_dir.path().join("seg").to_string_lossy().as_bytes()).unwrap();
+            file_writer_new_segmented(dir.as_ptr(), c"{}.log".as_ptr(), 1024, &mut handle);
+            assert_eq!((*(handle as *const buffer::FileWriterCursor)).cap, 0);
+            assert_eq!(file_writer_close(handle), FileWriterError::Success);
+        }
+
+        assert_eq!(std::fs::read_to_string(&path).unwrap(), "rust inline");
     }
 }
@@ -0,0 +1,50 @@
+//! Length-prefixed records: an unsigned LEB128 varint length followed by
+//! the payload bytes.
+
+/// The longest LEB128 encoding of a `u64`.
+pub(crate) const MAX_VARINT_LEN: usize = 10;
+
+/// Encodes `value` into the start of `buf`, returning the encoded length.
+#[inline]
+pub(crate) fn encode_varint(mut value: u64, buf: &mut [u8; MAX_VARINT_LEN]) -> usize {
+    let mut i = 0;
+    while value >= 0x80 {
+        buf[i] = value as u8 | 0x80;
+        value >>= 7;
+        i += 1;
+    }
+    buf[i] = value as u8;
+    i + 1
+}
+
+/// Length of the LEB128 encoding of `value`.
+#[inline]
+pub(crate) fn varint_len(value: u64) -> usize {
+    let bits = 64 - (value | 1).leading_zeros() as usize;
+    bits.div_ceil(7)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_varint_encoding() {
+        let cases: [(u64, &[u8]); 5] = [
+            (0, &[0x00]),
+            (127, &[0x7F]),
+            (128, &[0x80, 0x01]),
+            (300, &[0xAC, 0x02]),
+            (
+                u64::MAX,
+                &[0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x01],
+            ),
+        ];
+        let mut buf = [0u8; MAX_VARINT_LEN];
+        for (value, encoded) in cases {
+            let len = encode_varint(value, &mut buf);
+            assert_eq!(&buf[..len], encoded, "{value}");
+            assert_eq!(varint_len(value), len, "{value}");
+        }
+    }
+}
@@ -0,0 +1,231 @@
+//! Fixed-size circular "flight recorder" files.
+//!
+//! The file is a 64-byte header followed by `capacity` data bytes, mapped
+//! into memory. Writes are copied straight into the mapping and wrap around
+//! to overwrite the oldest data; the header tracks where the next write
+//! goes. Because the mapping is shared with the page cache, everything
+//! written survives a crash of the writing process without any flush.
+
+use std::fs::{File, OpenOptions};
+use std::io::{self, Read};
+use std::os::fd::AsRawFd;
+use std::path::Path;
+use std::ptr;
+use std::sync::atomic::{AtomicU64, Ordering};
+
+const MAGIC: [u8; 8] = *b"FWRING01";
+pub const HEADER_SIZE: usize = 64;
+
+#[repr(C)]
+struct Header {
+    magic: [u8; 8],
+    capacity: u64,
+    /// Offset in the data region the next write starts at.
+    head: AtomicU64,
+    /// Total bytes ever written; more than `capacity` means the data wrapped.
+    seq: AtomicU64,
+    _reserved: [u8; 32],
+}
+
+const _: () = assert!(std::mem::size_of::<Header>() == HEADER_SIZE);
+
+pub struct FlightRecorder {
+    map: *mut u8,
+    map_len: usize,
+    capacity: u64,
+    _file: File,
+}
+
+unsafe impl Send for FlightRecorder {}
+
+impl FlightRecorder {
+    /// Opens the recorder at `path`. An existing recorder of the same
+    /// capacity is continued where it left off; anything else is replaced by
+    /// an empty recorder.
+    pub fn open(path: &Path, capacity: u64) -> io::Result<Self> {
+        if capacity == 0 {
+            return Err(io::ErrorKind::InvalidInput.into());
+        }
+        let map_len = usize::try_from(capacity)
+            .ok()
+            .and_then(|c| c.checked_add(HEADER_SIZE))
+            .ok_or(io::ErrorKind::InvalidInput)?;
+
+        let file = OpenOptions::new()
+            .read(true)
+            .write(true)
+            .create(true)
+            .truncate(false)
+            .open(path)?;
+        let resume = file.metadata()?.len() == map_len as u64
+            && read_header(&file).is_ok_and(|(magic, cap, ..)| magic == MAGIC && cap == capacity);
+        if !resume {
+            file.set_len(0)?;
+            file.set_len(map_len as u64)?;
+            preallocate(&file, map_len);
+        }
+
+        let map = unsafe {
+            libc::mmap(
+                ptr::null_mut(),
+                map_len,
+                libc::PROT_READ | libc::PROT_WRITE,
+                libc::MAP_SHARED,
+                file.as_raw_fd(),
+                0,
+            )
+        };
+        if map == libc::MAP_FAILED {
+            return Err(io::Error::last_os_error());
+        }
+
+        let recorder = FlightRecorder {
+            map: map.cast(),
+            map_len,
+            capacity,
+            _file: file,
+        };
+        if !resume {
+            let header = recorder.map.cast::<Header>();
+            unsafe {
+                (*header).magic = MAGIC;
+                (*header).capacity = capacity;
+            }
+        }
+        Ok(recorder)
+    }
+
+    #[inline(always)]
+    fn header(&self) -> &Header {
+        unsafe { &*self.map.cast::<Header>() }
+    }
+
+    /// Appends `data`, overwriting the oldest bytes once the file is full.
+    #[inline]
+    pub fn write(&mut self, mut data: &[u8]) {
+        let header = self.header();
+        let mut seq = header.seq.load(Ordering::Relaxed);
+        let capacity = self.capacity as usize;
+
+        if data.len() > capacity {
+            // Only the newest `capacity` bytes can be kept.
+            seq += (data.len() - capacity) as u64;
+            data = &data[data.len() - capacity..];
+        }
+
+        let head = (seq % self.capacity) as usize;
+        let first = data.len().min(capacity - head);
+        unsafe {
+            let base = self.map.add(HEADER_SIZE);
+            ptr::copy_nonoverlapping(data.as_ptr(), base.add(head), first);
+            ptr::copy_nonoverlapping(data.as_ptr().add(first), base, data.len() - first);
+        }
+
+        seq += data.len() as u64;
+        header.head.store(seq % self.capacity, Ordering::Release);
+        header.seq.store(seq, Ordering::Release);
+    }
+
+    /// Writes the mapping back to disk (`msync`), for power-loss durability.
+    pub fn sync(&self) -> io::Result<()> {
+        if unsafe { libc::msync(self.map.cast(), self.map_len, libc::MS_SYNC) } != 0 {
+            return Err(io::Error::last_os_error());
+        }
+        Ok(())
+    }
+}
+
+impl Drop for FlightRecorder {
+    fn drop(&mut self) {
+        unsafe {
+            libc::munmap(self.map.cast(), self.map_len);
+        }
+    }
+}
+
+fn read_header(mut file: &File) -> io::Result<([u8; 8], u64, u64, u64)> {
+    let mut raw = [0u8; HEADER_SIZE];
+    file.read_exact(&mut raw)?;
+    let word = |i: usize| u64::from_ne_bytes(raw[i..i + 8].try_into().unwrap());
+    Ok((raw[..8].try_into().unwrap(), word(8), word(16), word(24)))
+}
+
+#[cfg(target_os = "linux")]
+fn preallocate(file: &File, len: usize) {
+    unsafe {
+        libc::fallocate(file.as_raw_fd(), 0, 0, len as libc::off_t);
+    }
+}
+
+#[cfg(not(target_os = "linux"))]
+fn preallocate(_file: &File, _len: usize) {}
+
+/// Reads a recorder file back, returning the retained bytes oldest first.
+pub fn read_recorder(path: &Path) -> io::Result<Vec<u8>> {
+    let mut file = File::open(path)?;
+    let (magic, capacity, head, seq) = read_header(&file)?;
+    // The data region must really be there before it is allocated for.
+    let data_len = file.metadata()?.len().saturating_sub(HEADER_SIZE as u64);
+    if magic != MAGIC || capacity == 0 || head >= capacity || capacity > data_len {
+        return Err(io::ErrorKind::InvalidData.into());
+    }
+
+    let mut data = vec![0u8; capacity as usize];
+    file.read_exact(&mut data)?;
+    if seq <= capacity {
+        data.truncate(seq as usize);
+    } else {
+        data.rotate_left(head as usize);
+    }
+    Ok(data)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use tempfile::TempDir;
+
+    #[test]
+    fn test_wraps_and_reads_back_in_order() {
+        let temp_dir = TempDir::new().unwrap();
+        let path = temp_dir.path().join("trace.ring");
+
+        let mut recorder = FlightRecorder::open(&path, 10).unwrap();
+        recorder.write(b"abcdef");
+        assert_eq!(read_recorder(&path).unwrap(), b"abcdef");
+        recorder.write(b"ghijkl");
+        assert_eq!(read_recorder(&path).unwrap(), b"cdefghijkl");
+        drop(recorder);
+
+        // Reopening continues the same ring.
+        let mut recorder = FlightRecorder::open(&path, 10).unwrap();
+        recorder.write(b"mn");
+        assert_eq!(read_recorder(&path).unwrap(), b"efghijklmn");
+        recorder.write(b"0123456789ABC");
+        assert_eq!(read_recorder(&path).unwrap(), b"3456789ABC");
+        drop(recorder);
+
+        // A different capacity starts over.
+        FlightRecorder::open(&path, 4).unwrap().write(b"xy");
+        assert_eq!(read_recorder(&path).unwrap(), b"xy");
+    }
+
+    #[test]
+    fn test_rejects_capacity_beyond_the_file() {
+        let temp_dir = TempDir::new().unwrap();
+        let path = temp_dir.path().join("trace.ring");
+        FlightRecorder::open(&path, 10).unwrap().write(b"abc");
+
+        // Truncated data region.
+        let file = OpenOptions::new().write(true).open(&path).unwrap();
+        file.set_len(HEADER_SIZE as u64 + 9).unwrap();
+        let err = read_recorder(&path).unwrap_err();
+        assert_eq!(err.kind(), io::ErrorKind::InvalidData);
+
+        // Corrupt capacity: must fail without trying to allocate it.
+        file.set_len(HEADER_SIZE as u64 + 10).unwrap();
+        std::os::unix::fs::FileExt::write_all_at(&file, &u64::MAX.to_ne_bytes(), 8).unwrap();
+        let err = read_recorder(&path).unwrap_err();
+        assert_eq!(err.kind(), io::ErrorKind::InvalidData);
+    }
+}
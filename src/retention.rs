@@ -0,0 +1,117 @@
+//! Retention of rotated output: which closed files to delete, and deleting
+//! them at a bounded rate so the unlinks do not compete with the writer for
+//! the filesystem journal.
+
+use std::collections::VecDeque;
+use std::fs::{self, OpenOptions};
+use std::io;
+use std::path::PathBuf;
+use std::time::Duration;
+
+/// Large files are shrunk by this much per step before they are unlinked,
+/// so freeing their extents is spread out instead of happening in one go.
+const TRUNCATE_STEP: u64 = 64 * 1024 * 1024;
+
+pub(crate) struct Retention {
+    /// Maximum number of files, counting the one being written. 0 = no limit.
+    max_files: u64,
+    /// Maximum total size of the closed files. 0 = no limit.
+    max_bytes: u64,
+    /// Deletion rate limit. 0 = no limit.
+    pub(crate) bytes_per_sec: u64,
+    /// Closed files, oldest first, with their sizes.
+    files: VecDeque<(PathBuf, u64)>,
+    bytes: u64,
+}
+
+impl Retention {
+    pub(crate) fn new(max_files: u64, max_bytes: u64, bytes_per_sec: u64) -> Self {
+        Retention {
+            max_files,
+            max_bytes,
+            bytes_per_sec,
+            files: VecDeque::new(),
+            bytes: 0,
+        }
+    }
+
+    /// Records a file that was just closed.
+    pub(crate) fn push(&mut self, path: PathBuf, size: u64) {
+        self.bytes += size;
+        self.files.push_back((path, size));
+    }
+
+    /// Pops the oldest files until the rule holds again.
+    pub(crate) fn expired(&mut self) -> VecDeque<(PathBuf, u64)> {
+        let mut expired = VecDeque::new();
+        while let Some((_, size)) = self.files.front() {
+            let too_many = self.max_files > 0 && self.files.len() as u64 >= self.max_files;
+            let too_big = self.max_bytes > 0 && self.bytes > self.max_bytes;
+            if !too_many && !too_big {
+                break;
+            }
+            self.bytes -= size;
+            expired.push_back(self.files.pop_front().unwrap());
+        }
+        expired
+    }
+}
+
+/// Deletes files from the front of `queue` for one step. With a rate limit
+/// a step frees at most `TRUNCATE_STEP` bytes, and the returned duration is
+/// how long to wait before the next one; without a limit the whole queue is
+/// deleted and `None` returned.
+pub(crate) fn delete_step(
+    queue: &mut VecDeque<(PathBuf, u64)>,
+    bytes_per_sec: u64,
+) -> Option<Duration> {
+    while let Some((path, size)) = queue.pop_front() {
+        if bytes_per_sec == 0 {
+            let _ = fs::remove_file(&path);
+            continue;
+        }
+
+        let freed = if size > TRUNCATE_STEP && shrink(&path, size - TRUNCATE_STEP).is_ok() {
+            queue.push_front((path, size - TRUNCATE_STEP));
+            TRUNCATE_STEP
+        } else {
+            let _ = fs::remove_file(&path);
+            size
+        };
+        if queue.is_empty() {
+            return None;
+        }
+        return Some(Duration::from_secs_f64(freed as f64 / bytes_per_sec as f64));
+    }
+    None
+}
+
+fn shrink(path: &PathBuf, len: u64) -> io::Result<()> {
+    OpenOptions::new().write(true).open(path)?.set_len(len)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use tempfile::TempDir;
+
+    #[test]
+    fn test_rate_limited_delete_shrinks_large_files_first() {
+        let temp_dir = TempDir::new().unwrap();
+        let big = temp_dir.path().join("big");
+        let small = temp_dir.path().join("small");
+        let big_size = TRUNCATE_STEP + 1000;
+        fs::File::create(&big).unwrap().set_len(big_size).unwrap();
+        fs::write(&small, b"x").unwrap();
+
+        let mut queue = VecDeque::from([(big.clone(), big_size), (small.clone(), 1)]);
+        let wait = delete_step(&mut queue, TRUNCATE_STEP).unwrap();
+        assert_eq!(wait, Duration::from_secs(1));
+        assert_eq!(fs::metadata(&big).unwrap().len(), 1000);
+
+        assert!(delete_step(&mut queue, TRUNCATE_STEP).is_some());
+        assert!(!big.exists());
+        assert!(delete_step(&mut queue, TRUNCATE_STEP).is_none());
+        assert!(!small.exists());
+    }
+}
@@ -0,0 +1,625 @@
+//! Rollover to a fresh output file, either once the current one is full
+//! (numbered segments) or on wall-clock boundaries (time-named files).
+//!
+//! The next file is always opened ahead of time by a background worker, so
+//! the rollover on the write path is a swap of two `OutputBuffer`s; the old
+//! one is flushed and closed in the background too. Whether it is time to
+//! switch is decided on the write path itself, from the clock, and the write
+//! path never waits for the worker: if the next file is not open yet, writes
+//! go on to the current one and the switch is retried on the next write.
+
+use crate::background::{self, Handover, Job};
+use crate::buffer::OutputBuffer;
+use crate::retention::Retention;
+use crate::sink::Sink;
+use std::fs;
+use std::io::{self, Write};
+use std::mem;
+use std::path::{Path, PathBuf};
+use std::sync::Arc;
+use std::time::{Duration, Instant, SystemTime, UNIX_EPOCH};
+
+const INDEX_PLACEHOLDER: &str = "{}";
+
+/// Time-named files are opened at most this long before their boundary.
+const MAX_PREPARE_LEAD: Duration = Duration::from_secs(30);
+
+enum Trigger {
+    Size {
+        prefix: String,
+        suffix: String,
+        /// Index of the segment the worker is preparing.
+        next_index: u64,
+        segment_size: u64,
+        written: u64,
+    },
+    Time {
+        pattern: String,
+        period: u64,
+        /// Unix time at which the current file's period started.
+        current_start: u64,
+        /// The period the worker is preparing a file for.
+        next_start: u64,
+    },
+}
+
+pub(crate) struct Rotation {
+    dir: PathBuf,
+    trigger: Trigger,
+    capacity: usize,
+    handover: Arc<Handover>,
+    /// The file being written.
+    current: PathBuf,
+    /// The file the worker is preparing, removed on close if never used.
+    pending: PathBuf,
+}
+
+impl Rotation {
+    /// Opens the first segment in `dir` and starts preparing the second.
+    /// `template` names the segments, with `{}` standing for the segment
+    /// index; numbering continues after any segments already in `dir`.
+    pub(crate) fn segmented(
+        dir: &Path,
+        template: &str,
+        segment_size: u64,
+        capacity: usize,
+    ) -> io::Result<(Self, OutputBuffer<Sink>)> {
+        let (prefix, suffix) = match template.split_once(INDEX_PLACEHOLDER) {
+            Some((p, s)) if !s.contains(INDEX_PLACEHOLDER) && !template.contains('/') => (p, s),
+            _ => return Err(io::ErrorKind::InvalidInput.into()),
+        };
+
+        fs::create_dir_all(dir)?;
+
+        let mut rotation = Rotation {
+            dir: dir.to_path_buf(),
+            trigger: Trigger::Size {
+                prefix: prefix.to_string(),
+                suffix: suffix.to_string(),
+                next_index: 0,
+                segment_size,
+                written: 0,
+            },
+            capacity,
+            handover: Arc::default(),
+            current: PathBuf::new(),
+            pending: PathBuf::new(),
+        };
+        let first_index = rotation
+            .existing_segments()?
+            .last()
+            .map_or(0, |&(i, _)| i + 1);
+        rotation.current = rotation.segment_path(first_index);
+        let file = background::open_preallocated(&rotation.current, false, segment_size)?;
+
+        if let Trigger::Size { next_index, .. } = &mut rotation.trigger {
+            *next_index = first_index + 1;
+        }
+        rotation.prepare_next();
+
+        Ok((
+            rotation,
+            OutputBuffer::with_capacity(capacity, Sink::new(file)),
+        ))
+    }
+
+    /// Opens (for append) the file for the current `period`-second interval
+    /// and schedules the switch to the next one. Periods are aligned to the
+    /// Unix epoch, so hourly files switch at the top of each UTC hour.
+    /// `pattern` is a path relative to `dir` using `%Y %m %d %H %M %S %%`.
+    pub(crate) fn timed(
+        dir: &Path,
+        pattern: &str,
+        period: u64,
+        capacity: usize,
+    ) -> io::Result<(Self, OutputBuffer<Sink>)> {
+        format_time(pattern, 0)?;
+
+        let current_start = period_start(period);
+        let mut rotation = Rotation {
+            dir: dir.to_path_buf(),
+            trigger: Trigger::Time {
+                pattern: pattern.to_string(),
+                period,
+                current_start,
+                next_start: current_start + period,
+            },
+            capacity,
+            handover: Arc::default(),
+            current: PathBuf::new(),
+            pending: PathBuf::new(),
+        };
+        rotation.current = rotation.time_path(current_start);
+        let file = background::open_preallocated(&rotation.current, true, 0)?;
+        rotation.prepare_next();
+
+        Ok((
+            rotation,
+            OutputBuffer::with_capacity(capacity, Sink::new(file)),
+        ))
+    }
+
+    /// Called before `len` bytes are written as one unit; switches to the
+    /// prepared file first if the current one is full or its period is over
+    /// and the next file is ready. A single write never straddles two files.
+    #[inline(always)]
+    pub(crate) fn before_write(
+        &mut self,
+        writer: &mut OutputBuffer<Sink>,
+        len: usize,
+    ) -> io::Result<()> {
+        self.roll_if_full(writer, len)?;
+        self.extend(len);
+        Ok(())
+    }
+
+    /// The first half of `before_write`, for a unit whose final size is not
+    /// known yet: switches files if `len` bytes would not fit, but leaves the
+    /// counting to `extend`.
+    #[inline(always)]
+    pub(crate) fn roll_if_full(
+        &mut self,
+        writer: &mut OutputBuffer<Sink>,
+        len: usize,
+    ) -> io::Result<()> {
+        if self.is_due(len) {
+            self.roll(writer)?;
+        }
+        Ok(())
+    }
+
+    /// Commits `size` bytes of the writer's reservation as one unit. Whether
+    /// the unit needs the next file is decided here, from its real size, not
+    /// from however much space was reserved for it; if so it is moved there.
+    #[inline(always)]
+    pub(crate) fn commit(
+        &mut self,
+        writer: &mut OutputBuffer<Sink>,
+        size: usize,
+    ) -> io::Result<()> {
+        if self.is_due(size) {
+            return self.commit_rolling(writer, size);
+        }
+        writer.commit(size)?;
+        self.extend(size);
+        Ok(())
+    }
+
+    #[cold]
+    fn commit_rolling(&mut self, writer: &mut OutputBuffer<Sink>, size: usize) -> io::Result<()> {
+        let unit = writer.reserved(size)?.to_vec();
+        self.roll(writer)?;
+        writer.write_all(&unit)?;
+        self.extend(size);
+        Ok(())
+    }
+
+    /// True if `len` more bytes belong in the next file.
+    #[inline(always)]
+    fn is_due(&self, len: usize) -> bool {
+        match self.trigger {
+            Trigger::Size {
+                segment_size,
+                written,
+                ..
+            } => written > 0 && written + len as u64 > segment_size,
+            Trigger::Time {
+                period,
+                current_start,
+                ..
+            } => coarse_unix_now() >= current_start + period,
+        }
+    }
+
+    /// Counts `len` more bytes of the unit the last `before_write` started,
+    /// without switching files, so that the unit stays in one file.
+    #[inline(always)]
+    pub(crate) fn extend(&mut self, len: usize) {
+        if let Trigger::Size { written, .. } = &mut self.trigger {
+            *written += len as u64;
+        }
+    }
+
+    #[cold]
+    fn roll(&mut self, writer: &mut OutputBuffer<Sink>) -> io::Result<()> {
+        let mut now_start = 0;
+        if let Trigger::Time {
+            period,
+            current_start,
+            ..
+        } = self.trigger
+        {
+            now_start = period_start(period);
+            // The coarse clock never runs ahead of this one, but do not
+            // reopen the current period's file if it ever did.
+            if now_start <= current_start {
+                return Ok(());
+            }
+        }
+
+        // Until the worker has the next file open, stay on this one.
+        let Some(next) = self.handover.try_take() else {
+            return Ok(());
+        };
+
+        if let Trigger::Time { next_start, .. } = self.trigger {
+            if next_start != now_start {
+                // Idle across more than one boundary: the prepared file is
+                // for a period that is already over.
+                if next.is_ok() {
+                    drop(next);
+                    let _ = remove_if_empty(&self.pending);
+                }
+                self.prepare_period(now_start, Instant::now());
+                return Ok(());
+            }
+        }
+
+        let next = match next {
+            Ok(next) => next,
+            Err(e) => {
+                // Keep writing to the current file; retry on the next write.
+                self.prepare_next();
+                return Err(e);
+            }
+        };
+
+        let old = mem::replace(writer, next);
+        background::submit(Job::Close {
+            writer: old,
+            path: mem::replace(&mut self.current, self.pending.clone()),
+            handover: self.handover.clone(),
+        });
+        match &mut self.trigger {
+            Trigger::Size { written, .. } => *written = 0,
+            Trigger::Time { current_start, .. } => *current_start = now_start,
+        }
+        self.prepare_next();
+        Ok(())
+    }
+
+    fn prepare_next(&mut self) {
+        match self.trigger {
+            Trigger::Size {
+                ref mut next_index,
+                segment_size,
+                ..
+            } => {
+                let index = *next_index;
+                *next_index += 1;
+                self.pending = self.segment_path(index);
+                background::submit(self.open_job(false, segment_size));
+            }
+            Trigger::Time {
+                period,
+                current_start,
+                ..
+            } => {
+                let start = current_start + period;
+
+                // Spread the opens of many writers sharing a boundary over
+                // the lead window instead of opening them all at once.
+                let boundary = instant_at(start);
+                let lead = MAX_PREPARE_LEAD.min(Duration::from_secs(period) / 2);
+                let jitter = Duration::from_millis(
+                    path_hash(&self.time_path(start)) % (lead.as_millis() as u64).max(1),
+                );
+                let open_at = boundary
+                    .checked_sub(lead)
+                    .map_or(Instant::now(), |t| t + jitter);
+
+                self.prepare_period(start, open_at);
+            }
+        }
+    }
+
+    /// Has the worker open the file for the period starting at `start`, no
+    /// earlier than `open_at`.
+    fn prepare_period(&mut self, start: u64, open_at: Instant) {
+        if let Trigger::Time { next_start, .. } = &mut self.trigger {
+            *next_start = start;
+        }
+        self.pending = self.time_path(start);
+        background::submit_at(open_at, self.open_job(true, 0));
+    }
+
+    fn open_job(&self, append: bool, preallocate: u64) -> Job {
+        Job::Open {
+            path: self.pending.clone(),
+            append,
+            preallocate,
+            capacity: self.capacity,
+            handover: self.handover.clone(),
+        }
+    }
+
+    pub(crate) fn set_capacity(&mut self, capacity: usize) {
+        self.capacity = capacity;
+    }
+
+    /// Starts enforcing a retention rule. Files from earlier runs that match
+    /// the naming scheme count towards it too, oldest (by name) first.
+    pub(crate) fn set_retention(
+        &mut self,
+        max_files: u64,
+        max_bytes: u64,
+        bytes_per_sec: u64,
+    ) -> io::Result<()> {
+        let mut retention = Retention::new(max_files, max_bytes, bytes_per_sec);
+        for path in self.existing_files()? {
+            if path != self.current && path != self.pending {
+                let size = fs::metadata(&path)?.len();
+                retention.push(path, size);
+            }
+        }
+
+        let files = retention.expired();
+        *self.handover.retention.lock().unwrap() = Some(retention);
+        if !files.is_empty() {
+            background::submit(Job::Remove {
+                files,
+                bytes_per_sec,
+            });
+        }
+        Ok(())
+    }
+
+    /// Cancels pending preparation, waits for this handle's background jobs
+    /// to complete and removes a prepared file that was never written to.
+    pub(crate) fn finish(self) -> io::Result<()> {
+        if let Some(Ok(unused)) = self.handover.shut_down() {
+            drop(unused);
+            remove_if_empty(&self.pending)?;
+        }
+        if self.handover.take_close_failure() {
+            return Err(io::Error::other("closing a previous file failed"));
+        }
+        Ok(())
+    }
+
+    /// Waits up to `timeout` for the next file to be ready to switch to.
+    #[cfg(test)]
+    pub(crate) fn wait_prepared(&self, timeout: Duration) -> bool {
+        self.handover.wait_prepared(timeout)
+    }
+
+    fn segment_path(&self, index: u64) -> PathBuf {
+        match &self.trigger {
+            Trigger::Size { prefix, suffix, .. } => {
+                self.dir.join(format!("{}{:06}{}", prefix, index, suffix))
+            }
+            Trigger::Time { .. } => unreachable!("segment path for a timed rotation"),
+        }
+    }
+
+    fn time_path(&self, start: u64) -> PathBuf {
+        match &self.trigger {
+            // The pattern was validated in `timed`.
+            Trigger::Time { pattern, .. } => self.dir.join(format_time(pattern, start).unwrap()),
+            Trigger::Size { .. } => unreachable!("time path for a segmented rotation"),
+        }
+    }
+
+    /// Files in `dir` that follow the naming scheme, oldest first.
+    fn existing_files(&self) -> io::Result<Vec<PathBuf>> {
+        match &self.trigger {
+            Trigger::Size { .. } => Ok(self
+                .existing_segments()?
+                .into_iter()
+                .map(|(_, path)| path)
+                .collect()),
+            Trigger::Time { pattern, .. } => {
+                let depth = pattern.split('/').count();
+                let mut files = Vec::new();
+                collect_files(&self.dir, depth, &mut files)?;
+                files.retain(|path| {
+                    path.strip_prefix(&self.dir)
+                        .ok()
+                        .and_then(|rel| rel.to_str())
+                        .is_some_and(|rel| matches_pattern(pattern, rel))
+                });
+                // Patterns list their fields most significant first, so the
+                // names sort chronologically.
+                files.sort();
+                Ok(files)
+            }
+        }
+    }
+
+    /// Segments in `dir` that match the template, by ascending index.
+    fn existing_segments(&self) -> io::Result<Vec<(u64, PathBuf)>> {
+        let (prefix, suffix) = match &self.trigger {
+            Trigger::Size { prefix, suffix, .. } => (prefix.as_str(), suffix.as_str()),
+            Trigger::Time { .. } => return Ok(Vec::new()),
+        };
+
+        let mut segments = Vec::new();
+        for entry in fs::read_dir(&self.dir)? {
+            let entry = entry?;
+            let name = entry.file_name();
+            let index = name
+                .to_str()
+                .and_then(|n| n.strip_prefix(prefix))
+                .and_then(|n| n.strip_suffix(suffix))
+                .filter(|n| !n.is_empty() && n.bytes().all(|b| b.is_ascii_digit()))
+                .and_then(|n| n.parse().ok());
+            if let Some(index) = index {
+                segments.push((index, entry.path()));
+            }
+        }
+        segments.sort_unstable();
+        Ok(segments)
+    }
+}
+
+fn collect_files(dir: &Path, depth: usize, files: &mut Vec<PathBuf>) -> io::Result<()> {
+    for entry in fs::read_dir(dir)? {
+        let entry = entry?;
+        let file_type = entry.file_type()?;
+        if file_type.is_file() && depth == 1 {
+            files.push(entry.path());
+        } else if file_type.is_dir() && depth > 1 {
+            collect_files(&entry.path(), depth - 1, files)?;
+        }
+    }
+    Ok(())
+}
+
+/// Whether `name` could have been produced by `format_time(pattern, _)`.
+fn matches_pattern(pattern: &str, name: &str) -> bool {
+    let mut name = name.as_bytes();
+    let mut chars = pattern.chars();
+    while let Some(c) = chars.next() {
+        let digits = match c {
+            '%' => match chars.next() {
+                Some('Y') => 4,
+                Some('m' | 'd' | 'H' | 'M' | 'S') => 2,
+                Some('%') => 0,
+                _ => return false,
+            },
+            _ => 0,
+        };
+        name = if digits > 0 {
+            match name.split_at_checked(digits) {
+                Some((head, rest)) if head.iter().all(u8::is_ascii_digit) => rest,
+                _ => return false,
+            }
+        } else {
+            // `c` is the literal character, which is also right for `%%`.
+            match name.strip_prefix(c.encode_utf8(&mut [0; 4]).as_bytes()) {
+                Some(rest) => rest,
+                None => return false,
+            }
+        };
+    }
+    name.is_empty()
+}
+
+fn remove_if_empty(path: &Path) -> io::Result<()> {
+    if fs::metadata(path)?.len() == 0 {
+        fs::remove_file(path)?;
+    }
+    Ok(())
+}
+
+fn unix_now() -> u64 {
+    SystemTime::now()
+        .duration_since(UNIX_EPOCH)
+        .map_or(0, |d| d.as_secs())
+}
+
+/// Like `unix_now`, from the clock the kernel updates once per tick: a few
+/// ns to read, for the check on every write. It lags by at most a tick
+/// (a few ms), so a write that close after a boundary may still go to the
+/// file of the period that just ended.
+#[cfg(target_os = "linux")]
+#[inline(always)]
+fn coarse_unix_now() -> u64 {
+    let mut now = libc::timespec {
+        tv_sec: 0,
+        tv_nsec: 0,
+    };
+    if unsafe { libc::clock_gettime(libc::CLOCK_REALTIME_COARSE, &mut now) } == 0 {
+        return now.tv_sec as u64;
+    }
+    unix_now()
+}
+
+#[cfg(not(target_os = "linux"))]
+#[inline(always)]
+fn coarse_unix_now() -> u64 {
+    unix_now()
+}
+
+fn period_start(period: u64) -> u64 {
+    let now = unix_now();
+    now - now % period
+}
+
+fn instant_at(unix_secs: u64) -> Instant {
+    let target = UNIX_EPOCH + Duration::from_secs(unix_secs);
+    match target.duration_since(SystemTime::now()) {
+        Ok(ahead) => Instant::now() + ahead,
+        Err(_) => Instant::now(),
+    }
+}
+
+fn path_hash(path: &Path) -> u64 {
+    path.as_os_str()
+        .as_encoded_bytes()
+        .iter()
+        .fold(0xcbf2_9ce4_8422_2325, |h, &b| {
+            (h ^ b as u64).wrapping_mul(0x0100_0000_01b3)
+        })
+}
+
+/// Expands the strftime-style `%Y %m %d %H %M %S %%` in `pattern` for the
+/// UTC time `unix_secs`.
+pub(crate) fn format_time(pattern: &str, unix_secs: u64) -> io::Result<String> {
+    let days = (unix_secs / 86_400) as i64;
+    let secs_of_day = unix_secs % 86_400;
+    let (year, month, day) = civil_from_days(days);
+
+    let mut out = String::with_capacity(pattern.len() + 16);
+    let mut chars = pattern.chars();
+    while let Some(c) = chars.next() {
+        if c != '%' {
+            out.push(c);
+            continue;
+        }
+        match chars.next() {
+            Some('Y') => out.push_str(&format!("{:04}", year)),
+            Some('m') => out.push_str(&format!("{:02}", month)),
+            Some('d') => out.push_str(&format!("{:02}", day)),
+            Some('H') => out.push_str(&format!("{:02}", secs_of_day / 3600)),
+            Some('M') => out.push_str(&format!("{:02}", secs_of_day / 60 % 60)),
+            Some('S') => out.push_str(&format!("{:02}", secs_of_day % 60)),
+            Some('%') => out.push('%'),
+            _ => return Err(io::ErrorKind::InvalidInput.into()),
+        }
+    }
+    Ok(out)
+}
+
+/// Days since 1970-01-01 to a proleptic Gregorian (year, month, day).
+fn civil_from_days(days: i64) -> (i64, u32, u32) {
+    let z = days + 719_468;
+    let era = z.div_euclid(146_097);
+    let doe = z.rem_euclid(146_097);
+    let yoe = (doe - doe / 1460 + doe / 36_524 - doe / 146_096) / 365;
+    let doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    let mp = (5 * doy + 2) / 153;
+    let day = (doy - (153 * mp + 2) / 5 + 1) as u32;
+    let month = if mp < 10 { mp + 3 } else { mp - 9 } as u32;
+    let year = yoe + era * 400 + i64::from(month <= 2);
+    (year, month, day)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_format_time() {
+        assert_eq!(
+            format_time("%Y-%m-%d/%H%M%S.log", 0).unwrap(),
+            "1970-01-01/000000.log"
+        );
+        // 2024-02-29T13:45:07Z
+        assert_eq!(
+            format_time("%Y%m%d-%H:%M:%S 100%%", 1_709_214_307).unwrap(),
+            "20240229-13:45:07 100%"
+        );
+        assert!(format_time("%Q", 0).is_err());
+        assert!(format_time("trailing %", 0).is_err());
+    }
+
+    #[test]
+    fn test_matches_pattern() {
+        assert!(matches_pattern("%Y%m%d/%H.log", "20240229/13.log"));
+        assert!(matches_pattern("100%%-%H", "100%-07"));
+        assert!(!matches_pattern("%Y%m%d/%H.log", "20240229/13.log.tmp"));
+        assert!(!matches_pattern("%Y%m%d/%H.log", "2024022x/13.log"));
+        assert!(!matches_pattern("%H.log", "other.log"));
+    }
+}
@@ -0,0 +1,217 @@
+//! Byte scanning for the text writers, 16 bytes at a time: SSE2 on x86-64
+//! and NEON on aarch64 (both part of the baseline instruction set), with a
+//! scalar fallback elsewhere. The JSON scan also uses AVX2, 32 bytes at a
+//! time, when it is detected at run time.
+
+/// Index of the first byte in `hay` equal to any of `needles`.
+#[inline]
+pub(crate) fn find_any(hay: &[u8], needles: [u8; 4]) -> Option<usize> {
+    #[cfg(target_arch = "x86_64")]
+    {
+        unsafe { find_any_sse2(hay, needles) }
+    }
+    #[cfg(target_arch = "aarch64")]
+    {
+        unsafe { find_any_neon(hay, needles) }
+    }
+    #[cfg(not(any(target_arch = "x86_64", target_arch = "aarch64")))]
+    {
+        find_any_scalar(hay, needles, 0)
+    }
+}
+
+#[inline]
+fn find_any_scalar(hay: &[u8], needles: [u8; 4], from: usize) -> Option<usize> {
+    hay[from..]
+        .iter()
+        .position(|b| needles.contains(b))
+        .map(|i| from + i)
+}
+
+#[cfg(target_arch = "x86_64")]
+#[inline]
+unsafe fn find_any_sse2(hay: &[u8], needles: [u8; 4]) -> Option<usize> {
+    use std::arch::x86_64::*;
+
+    let [a, b, c, d] = needles.map(|n| _mm_set1_epi8(n as i8));
+    let mut i = 0;
+    while i + 16 <= hay.len() {
+        let v = _mm_loadu_si128(hay.as_ptr().add(i).cast());
+        let hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, a), _mm_cmpeq_epi8(v, b)),
+            _mm_or_si128(_mm_cmpeq_epi8(v, c), _mm_cmpeq_epi8(v, d)),
+        );
+        let mask = _mm_movemask_epi8(hits);
+        if mask != 0 {
+            return Some(i + mask.trailing_zeros() as usize);
+        }
+        i += 16;
+    }
+    find_any_scalar(hay, needles, i)
+}
+
+#[cfg(target_arch = "aarch64")]
+#[inline]
+unsafe fn find_any_neon(hay: &[u8], needles: [u8; 4]) -> Option<usize> {
+    use std::arch::aarch64::*;
+
+    let [a, b, c, d] = needles.map(|n| vdupq_n_u8(n));
+    let mut i = 0;
+    while i + 16 <= hay.len() {
+        let v = vld1q_u8(hay.as_ptr().add(i));
+        let hits = vorrq_u8(
+            vorrq_u8(vceqq_u8(v, a), vceqq_u8(v, b)),
+            vorrq_u8(vceqq_u8(v, c), vceqq_u8(v, d)),
+        );
+        if vmaxvq_u8(hits) != 0 {
+            return find_any_scalar(&hay[..i + 16], needles, i);
+        }
+        i += 16;
+    }
+    find_any_scalar(hay, needles, i)
+}
+
+/// Index of the first byte in `hay` that a JSON string must escape: `"`,
+/// `\` or a control character below 0x20.
+#[inline]
+pub(crate) fn find_json_escape(hay: &[u8]) -> Option<usize> {
+    #[cfg(target_arch = "x86_64")]
+    {
+        if hay.len() >= 32 && is_x86_feature_detected!("avx2") {
+            return unsafe { find_json_escape_avx2(hay) };
+        }
+        unsafe { find_json_escape_sse2(hay, 0) }
+    }
+    #[cfg(target_arch = "aarch64")]
+    {
+        unsafe { find_json_escape_neon(hay) }
+    }
+    #[cfg(not(any(target_arch = "x86_64", target_arch = "aarch64")))]
+    {
+        find_json_escape_scalar(hay, 0)
+    }
+}
+
+#[inline]
+fn needs_json_escape(b: u8) -> bool {
+    b < 0x20 || b == b'"' || b == b'\\'
+}
+
+#[inline]
+fn find_json_escape_scalar(hay: &[u8], from: usize) -> Option<usize> {
+    hay[from..]
+        .iter()
+        .position(|&b| needs_json_escape(b))
+        .map(|i| from + i)
+}
+
+#[cfg(target_arch = "x86_64")]
+#[target_feature(enable = "avx2")]
+unsafe fn find_json_escape_avx2(hay: &[u8]) -> Option<usize> {
+    use std::arch::x86_64::*;
+
+    let quote = _mm256_set1_epi8(b'"' as i8);
+    let backslash = _mm256_set1_epi8(b'\\' as i8);
+    let max_control = _mm256_set1_epi8(0x1F);
+    let mut i = 0;
+    while i + 32 <= hay.len() {
+        let v = _mm256_loadu_si256(hay.as_ptr().add(i).cast());
+        // Unsigned v <= 0x1F exactly when min(v, 0x1F) == v.
+        let control = _mm256_cmpeq_epi8(_mm256_min_epu8(v, max_control), v);
+        let hits = _mm256_or_si256(
+            control,
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, backslash)),
+        );
+        let mask = _mm256_movemask_epi8(hits);
+        if mask != 0 {
+            return Some(i + mask.trailing_zeros() as usize);
+        }
+        i += 32;
+    }
+    find_json_escape_sse2(hay, i)
+}
+
+#[cfg(target_arch = "x86_64")]
+#[inline]
+unsafe fn find_json_escape_sse2(hay: &[u8], from: usize) -> Option<usize> {
+    use std::arch::x86_64::*;
+
+    let quote = _mm_set1_epi8(b'"' as i8);
+    let backslash = _mm_set1_epi8(b'\\' as i8);
+    let max_control = _mm_set1_epi8(0x1F);
+    let mut i = from;
+    while i + 16 <= hay.len() {
+        let v = _mm_loadu_si128(hay.as_ptr().add(i).cast());
+        let control = _mm_cmpeq_epi8(_mm_min_epu8(v, max_control), v);
+        let hits = _mm_or_si128(
+            control,
+            _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+        );
+        let mask = _mm_movemask_epi8(hits);
+        if mask != 0 {
+            return Some(i + mask.trailing_zeros() as usize);
+        }
+        i += 16;
+    }
+    find_json_escape_scalar(hay, i)
+}
+
+#[cfg(target_arch = "aarch64")]
+#[inline]
+unsafe fn find_json_escape_neon(hay: &[u8]) -> Option<usize> {
+    use std::arch::aarch64::*;
+
+    let quote = vdupq_n_u8(b'"');
+    let backslash = vdupq_n_u8(b'\\');
+    let space = vdupq_n_u8(0x20);
+    let mut i = 0;
+    while i + 16 <= hay.len() {
+        let v = vld1q_u8(hay.as_ptr().add(i));
+        let hits = vorrq_u8(
+            vcltq_u8(v, space),
+            vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, backslash)),
+        );
+        if vmaxvq_u8(hits) != 0 {
+            return find_json_escape_scalar(&hay[..i + 16], i);
+        }
+        i += 16;
+    }
+    find_json_escape_scalar(hay, i)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_find_any_matches_scalar() {
+        let needles = [b',', b'"', b'\n', b'\r'];
+        let mut hay = vec![b'a'; 100];
+        assert_eq!(find_any(&hay, needles), None);
+        for pos in [0, 1, 15, 16, 17, 31, 64, 99] {
+            for &needle in &needles {
+                hay[pos] = needle;
+                assert_eq!(find_any(&hay, needles), Some(pos));
+                assert_eq!(find_any(&hay[..pos], needles), None);
+                hay[pos] = b'a';
+            }
+        }
+    }
+
+    #[test]
+    fn test_find_json_escape_matches_scalar() {
+        let mut hay = vec![b'a'; 100];
+        hay[50] = 0xC3; // bytes >= 0x80 never need escaping
+        assert_eq!(find_json_escape(&hay), None);
+        for pos in [0, 1, 15, 16, 31, 32, 33, 63, 64, 99] {
+            for needle in [b'"', b'\\', b'\n', 0x00, 0x1F] {
+                let saved = hay[pos];
+                hay[pos] = needle;
+                assert_eq!(find_json_escape(&hay), Some(pos));
+                assert_eq!(find_json_escape_scalar(&hay, 0), Some(pos));
+                assert_eq!(find_json_escape(&hay[..pos]), None);
+                hay[pos] = saved;
+            }
+        }
+    }
+}
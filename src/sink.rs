@@ -0,0 +1,202 @@
+//! The destination of a handle's buffered output: the file, optionally
+//! behind a compression codec and per-block CRC32C framing, in that order,
+//! and optionally hashing exactly what reaches the file.
+
+use crate::compress::Codec;
+use crate::digest::Digest;
+use crate::integrity::BlockCrc;
+use std::fs::File;
+use std::io::{self, Write};
+
+pub(crate) struct Sink {
+    file: File,
+    codec: Option<Box<dyn Codec>>,
+    block_crc: Option<BlockCrc>,
+    digest: Option<Digest>,
+    /// Codec output on its way to `file`; kept to reuse the allocation.
+    /// Whatever a failed file write left unwritten stays here for the next
+    /// write or flush.
+    out: Vec<u8>,
+    /// The same with CRC trailers inserted.
+    framed: Vec<u8>,
+}
+
+impl Sink {
+    pub(crate) fn new(file: File) -> Self {
+        Sink::with_stages(file, None, None, None)
+    }
+
+    pub(crate) fn with_stages(
+        file: File,
+        codec: Option<Box<dyn Codec>>,
+        block_crc: Option<BlockCrc>,
+        digest: Option<Digest>,
+    ) -> Self {
+        Sink {
+            file,
+            codec,
+            block_crc,
+            digest,
+            out: Vec::new(),
+            framed: Vec::new(),
+        }
+    }
+
+    /// `fdatasync` on the file. Call `flush` first.
+    pub(crate) fn sync_data(&self) -> io::Result<()> {
+        self.file.sync_data()?;
+        #[cfg(feature = "test-hooks")]
+        crate::test_hooks::record_sync(&self.file);
+        Ok(())
+    }
+
+    /// Writes out what the codec or CRC stage made of `len` input bytes.
+    /// Those stages cannot take input back, so the input counts as written
+    /// even if the file write fails: the rest stays staged, and the next
+    /// write or flush retries it and reports the error if it persists.
+    fn write_staged(&mut self, len: usize) -> io::Result<usize> {
+        let _ = self.write_out();
+        Ok(len)
+    }
+
+    fn write_out(&mut self) -> io::Result<()> {
+        match self.block_crc {
+            None => write_drained(&mut self.file, &mut self.out, &mut self.digest),
+            Some(ref mut crc) => {
+                crc.frame(&self.out, &mut self.framed);
+                self.out.clear();
+                write_drained(&mut self.file, &mut self.framed, &mut self.digest)
+            }
+        }
+    }
+
+    /// Ends the codec's output and the last CRC block and writes them out,
+    /// then returns the file.
+    pub(crate) fn finish(self) -> io::Result<File> {
+        self.finish_with_digest().map(|(file, _)| file)
+    }
+
+    /// Like `finish`, also returning the digest of everything written.
+    pub(crate) fn finish_with_digest(mut self) -> io::Result<(File, Option<Vec<u8>>)> {
+        if let Some(ref mut codec) = self.codec {
+            codec.finish(&mut self.out)?;
+            self.write_out()?;
+        }
+        if let Some(ref mut crc) = self.block_crc {
+            crc.finish(&mut self.framed);
+            write_drained(&mut self.file, &mut self.framed, &mut self.digest)?;
+        }
+        self.file.flush()?;
+        let digest = self.digest.as_ref().map(Digest::finish);
+        Ok((self.file, digest))
+    }
+}
+
+/// Writes `buf` to `file` and removes what was written from its front,
+/// keeping its allocation. On error the unwritten tail stays in `buf`, and
+/// only the bytes that reached the file are hashed.
+fn write_drained(
+    file: &mut File,
+    buf: &mut Vec<u8>,
+    digest: &mut Option<Digest>,
+) -> io::Result<()> {
+    let mut written = 0;
+    let result = loop {
+        if written == buf.len() {
+            break Ok(());
+        }
+        match file.write(&buf[written..]) {
+            Ok(0) => break Err(io::ErrorKind::WriteZero.into()),
+            Ok(n) => written += n,
+            Err(e) if e.kind() == io::ErrorKind::Interrupted => {}
+            Err(e) => break Err(e),
+        }
+    };
+    if let Some(digest) = digest {
+        digest.update(&buf[..written]);
+    }
+    buf.drain(..written);
+    result
+}
+
+impl Write for Sink {
+    #[inline]
+    fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        match (&mut self.codec, &mut self.block_crc) {
+            (None, None) => {
+                let written = self.file.write(buf)?;
+                if let Some(ref mut digest) = self.digest {
+                    digest.update(&buf[..written]);
+                }
+                Ok(written)
+            }
+            _ if !self.out.is_empty() || !self.framed.is_empty() => {
+                // A failed write left output staged. It goes out first, and
+                // until it does `buf` is refused and stays with the caller.
+                self.write_out()?;
+                self.write(buf)
+            }
+            (None, Some(crc)) => {
+                crc.frame(buf, &mut self.framed);
+                self.write_staged(buf.len())
+            }
+            (Some(codec), _) => {
+                codec.compress(buf, &mut self.out)?;
+                self.write_staged(buf.len())
+            }
+        }
+    }
+
+    fn flush(&mut self) -> io::Result<()> {
+        if let Some(ref mut codec) = self.codec {
+            codec.end_frame(&mut self.out)?;
+        }
+        self.write_out()?;
+        self.file.flush()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::FileWriterDigest;
+    use std::fs::{self, OpenOptions};
+    use tempfile::TempDir;
+
+    #[test]
+    fn test_failed_write_keeps_staged_output() {
+        let temp_dir = TempDir::new().unwrap();
+        let path = temp_dir.path().join("out.bin");
+        let read_only = || {
+            fs::write(&path, b"").unwrap();
+            File::open(&path).unwrap()
+        };
+
+        let mut sink = Sink::with_stages(
+            read_only(),
+            None,
+            Some(BlockCrc::new(4)),
+            Digest::new(FileWriterDigest::Xxh3_128).unwrap(),
+        );
+        // Framed, so accepted; the file write fails and the bytes stay staged.
+        assert_eq!(sink.write(b"abcdef").unwrap(), 6);
+        // Refused while the staged bytes cannot be written.
+        assert!(sink.write(b"gh").is_err());
+        assert!(sink.flush().is_err());
+
+        sink.file = OpenOptions::new().write(true).open(&path).unwrap();
+        sink.write_all(b"gh").unwrap();
+        let (_, digest) = sink.finish_with_digest().unwrap();
+
+        let mut expected = Vec::new();
+        let mut crc = BlockCrc::new(4);
+        crc.frame(b"abcdefgh", &mut expected);
+        crc.finish(&mut expected);
+        let content = fs::read(&path).unwrap();
+        assert_eq!(content, expected);
+
+        let mut hash = Digest::new(FileWriterDigest::Xxh3_128).unwrap().unwrap();
+        hash.update(&content);
+        assert_eq!(digest.unwrap(), hash.finish());
+    }
+}
@@ -0,0 +1,25 @@
+//! Observation points for the crash-consistency harness in `tests/`. Not
+//! part of the API: the harness uses them to learn what really reached the
+//! disk instead of trusting its own count of successful calls. Only built
+//! with the `test-hooks` feature, so normal builds do no extra work on sync.
+
+use std::cell::Cell;
+use std::fs::File;
+use std::io::Seek;
+
+thread_local! {
+    static SYNCED_OFFSET: Cell<Option<u64>> = const { Cell::new(None) };
+}
+
+/// Called after each successful `sync_data` on a handle's file.
+pub(crate) fn record_sync(mut file: &File) {
+    if let Ok(offset) = file.stream_position() {
+        SYNCED_OFFSET.with(|s| s.set(Some(offset)));
+    }
+}
+
+/// The file offset covered by the last `sync_data` on this thread, if any,
+/// and forgets it.
+pub fn take_synced_offset() -> Option<u64> {
+    SYNCED_OFFSET.with(|s| s.take())
+}
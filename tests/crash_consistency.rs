@@ -0,0 +1,421 @@
+//! Crash-consistency harness.
+//!
+//! Runs a record-framed workload through the C API, "crashes" at a random
+//! point and checks what survived against the durability policy the workload
+//! asked for:
+//!
+//! - `Policy::Flush`: everything acknowledged by `file_writer_flush` must
+//!   survive a process crash.
+//! - `Policy::Sync`: everything acknowledged by `file_writer_sync` must survive
+//!   a power loss, where the kernel may drop or truncate any unsynced range.
+//!
+//! The library writes through `std::fs::File`, so instead of interposing on
+//! the syscalls themselves the harness snapshots the file as the kernel holds
+//! it at the crash point and then applies the faults a crash is allowed to
+//! cause (truncation, dropped pages) to the unsynced tail of that image. What
+//! is unsynced comes from the library (`test_hooks::take_synced_offset`, the
+//! offset covered by the last real `fdatasync`), not from the harness's count
+//! of successful calls, so a sync that never reaches the disk is caught
+//! (`harness_detects_a_missing_sync`). The hook is only built with the
+//! `test-hooks` feature, which this test requires (`--all-features` or
+//! `--features test-hooks`).
+//!
+//! Recovery truncates the torn tail (the harness's own record scan, as an
+//! application would do it) and reopens the file in `FileWriterMode::Append`.
+//! `recovery_cost_large_files` reports both times on multi-GB files; only the
+//! reopen is the library's:
+//!
+//! ```bash
+//! FILE_WRITER_RECOVERY_GIB=1,4 cargo test --release --features test-hooks \
+//!     --test crash_consistency -- --ignored --nocapture
+//! ```
+
+use file_writer::{
+    file_writer_close, file_writer_flush, file_writer_new, file_writer_sync, file_writer_write_raw,
+    test_hooks, FileWriterError, FileWriterHandle, FileWriterMode,
+};
+use std::ffi::CString;
+use std::fs::{self, File, OpenOptions};
+use std::io::{BufReader, Read, Seek, SeekFrom, Write};
+use std::path::Path;
+use std::ptr::null_mut;
+use std::time::{Duration, Instant};
+use tempfile::TempDir;
+
+const PAGE_SIZE: u64 = 4096;
+const RECORD_HEADER: usize = 8; // u32 length + u32 checksum
+const MAX_PAYLOAD: usize = 4096;
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+enum Policy {
+    Flush,
+    Sync,
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+enum Crash {
+    /// The process dies: everything handed to `write(2)` is kept.
+    Process,
+    /// The machine dies: unsynced data may be truncated or lost page by page.
+    PowerLoss,
+}
+
+/// xorshift64*, so a failing run can be replayed with `FILE_WRITER_CRASH_SEED`.
+struct Rng(u64);
+
+impl Rng {
+    fn new(seed: u64) -> Self {
+        Rng(seed.max(1))
+    }
+
+    fn next(&mut self) -> u64 {
+        self.0 ^= self.0 >> 12;
+        self.0 ^= self.0 << 25;
+        self.0 ^= self.0 >> 27;
+        self.0.wrapping_mul(0x2545_F491_4F6C_DD1D)
+    }
+
+    fn below(&mut self, n: u64) -> u64 {
+        self.next() % n.max(1)
+    }
+}
+
+fn checksum(payload: &[u8]) -> u32 {
+    // FNV-1a: good enough to tell a torn record from an intact one.
+    payload.iter().fold(0x811c_9dc5u32, |h, &b| {
+        (h ^ b as u32).wrapping_mul(0x0100_0193)
+    })
+}
+
+fn encode_record(rng: &mut Rng, out: &mut Vec<u8>) {
+    let len = 1 + rng.below(MAX_PAYLOAD as u64) as usize;
+    let start = out.len();
+    out.extend_from_slice(&[0; RECORD_HEADER]);
+    out.extend((0..len).map(|_| rng.next() as u8));
+    let sum = checksum(&out[start + RECORD_HEADER..]);
+    out[start..start + 4].copy_from_slice(&(len as u32).to_le_bytes());
+    out[start + 4..start + 8].copy_from_slice(&sum.to_le_bytes());
+}
+
+/// Returns the length of the longest prefix made of intact records.
+fn scan_valid_prefix(reader: &mut impl Read) -> u64 {
+    let mut valid = 0u64;
+    let mut header = [0u8; RECORD_HEADER];
+    let mut payload = vec![0u8; MAX_PAYLOAD];
+    loop {
+        if reader.read_exact(&mut header).is_err() {
+            return valid;
+        }
+        let len = u32::from_le_bytes(header[..4].try_into().unwrap()) as usize;
+        let sum = u32::from_le_bytes(header[4..].try_into().unwrap());
+        if len == 0 || len > MAX_PAYLOAD || reader.read_exact(&mut payload[..len]).is_err() {
+            return valid;
+        }
+        if checksum(&payload[..len]) != sum {
+            return valid;
+        }
+        valid += (RECORD_HEADER + len) as u64;
+    }
+}
+
+struct Writer {
+    handle: *mut FileWriterHandle,
+}
+
+impl Writer {
+    fn open(path: &Path, mode: FileWriterMode) -> Self {
+        let c_path = CString::new(path.to_str().unwrap()).unwrap();
+        let mut handle = null_mut();
+        let result = unsafe { file_writer_new(c_path.as_ptr(), &mut handle, mode) };
+        assert_eq!(result, FileWriterError::Success);
+        Writer { handle }
+    }
+
+    fn write(&mut self, data: &[u8]) {
+        let result = unsafe { file_writer_write_raw(self.handle, data.as_ptr(), data.len()) };
+        assert_eq!(result, FileWriterError::Success);
+    }
+
+    fn acknowledge(&mut self, policy: Policy) {
+        let result = unsafe {
+            match policy {
+                Policy::Flush => file_writer_flush(self.handle),
+                Policy::Sync => file_writer_sync(self.handle),
+            }
+        };
+        assert_eq!(result, FileWriterError::Success);
+    }
+
+    fn close(self) {
+        let result = unsafe { file_writer_close(self.handle) };
+        assert_eq!(result, FileWriterError::Success);
+    }
+}
+
+struct Outcome {
+    /// Everything the workload handed to the writer, in order.
+    stream: Vec<u8>,
+    /// Bytes covered by the last successful flush/sync.
+    acknowledged: u64,
+    /// Bytes covered by the last `fdatasync` the library actually made.
+    synced: u64,
+}
+
+/// Writes `records` records, acknowledging every few of them with `policy`,
+/// and returns the still-open handle: the caller decides what the crash
+/// leaves behind.
+fn run_workload(path: &Path, policy: Policy, rng: &mut Rng, records: usize) -> (Writer, Outcome) {
+    let mut writer = Writer::open(path, FileWriterMode::Write);
+    let mut outcome = Outcome {
+        stream: Vec::new(),
+        acknowledged: 0,
+        synced: 0,
+    };
+    test_hooks::take_synced_offset();
+
+    for _ in 0..records {
+        let start = outcome.stream.len();
+        encode_record(rng, &mut outcome.stream);
+        writer.write(&outcome.stream[start..]);
+        if rng.below(8) == 0 {
+            writer.acknowledge(policy);
+            outcome.acknowledged = outcome.stream.len() as u64;
+        }
+    }
+    outcome.synced = test_hooks::take_synced_offset().unwrap_or(0);
+
+    (writer, outcome)
+}
+
+/// Copies the file as the kernel currently holds it and applies the faults
+/// `crash` is allowed to cause to everything past `durable`.
+fn crash_image(path: &Path, image: &Path, crash: Crash, durable: u64, rng: &mut Rng) {
+    fs::copy(path, image).unwrap();
+    if crash == Crash::Process {
+        return;
+    }
+
+    let file = OpenOptions::new().write(true).open(image).unwrap();
+    let len = file.metadata().unwrap().len();
+    if len <= durable {
+        return;
+    }
+
+    // Drop a few unsynced pages: delayed allocation may leave holes.
+    let first_page = durable.div_ceil(PAGE_SIZE);
+    let last_page = len / PAGE_SIZE;
+    if last_page > first_page {
+        for _ in 0..rng.below(3) {
+            let page = first_page + rng.below(last_page - first_page);
+            let mut f = &file;
+            f.seek(SeekFrom::Start(page * PAGE_SIZE)).unwrap();
+            f.write_all(&[0u8; PAGE_SIZE as usize]).unwrap();
+        }
+    }
+
+    // And cut the file anywhere in the unsynced range.
+    file.set_len(durable + rng.below(len - durable + 1))
+        .unwrap();
+}
+
+fn check_survivors(image: &Path, outcome: &Outcome, crash: Crash) -> u64 {
+    let survived = fs::read(image).unwrap();
+    let durable = outcome.acknowledged as usize;
+
+    assert!(
+        survived.len() >= durable,
+        "lost acknowledged data: {} of {} bytes survived",
+        survived.len(),
+        durable
+    );
+    assert_eq!(
+        &survived[..durable],
+        &outcome.stream[..durable],
+        "acknowledged data was corrupted"
+    );
+    if crash == Crash::Process {
+        // Nothing is reordered or invented past the acknowledged point.
+        assert_eq!(&survived[..], &outcome.stream[..survived.len()]);
+    }
+
+    let valid = scan_valid_prefix(&mut survived.as_slice());
+    assert!(valid >= outcome.acknowledged);
+    assert_eq!(
+        &survived[..valid as usize],
+        &outcome.stream[..valid as usize]
+    );
+    valid
+}
+
+/// Truncates the torn tail and reopens for append, as a restarted service
+/// would. Returns the time spent in the harness's scan and truncation (the
+/// application's part) and in reopening (the library's part).
+fn recover(path: &Path) -> (u64, Duration, Duration) {
+    let scan_start = Instant::now();
+    let valid = scan_valid_prefix(&mut BufReader::with_capacity(
+        1024 * 1024,
+        File::open(path).unwrap(),
+    ));
+    OpenOptions::new()
+        .write(true)
+        .open(path)
+        .unwrap()
+        .set_len(valid)
+        .unwrap();
+    let scan_time = scan_start.elapsed();
+
+    let reopen_start = Instant::now();
+    let writer = Writer::open(path, FileWriterMode::Append);
+    let reopen_time = reopen_start.elapsed();
+    writer.close();
+
+    (valid, scan_time, reopen_time)
+}
+
+fn crash_and_recover(policy: Policy, crash: Crash, seed: u64) {
+    crash_and_recover_acknowledging(policy, policy, crash, seed);
+}
+
+/// Checks the guarantees of `policy` on a workload that acknowledges with
+/// `acknowledge_with`; the two differ only to show that the harness notices.
+fn crash_and_recover_acknowledging(
+    policy: Policy,
+    acknowledge_with: Policy,
+    crash: Crash,
+    seed: u64,
+) {
+    let dir = TempDir::new().unwrap();
+    let path = dir.path().join("workload.log");
+    let image = dir.path().join("crashed.log");
+    let mut rng = Rng::new(seed);
+
+    let records = 1 + rng.below(1000) as usize;
+    let (writer, outcome) = run_workload(&path, acknowledge_with, &mut rng, records);
+
+    // What a crash may damage: a process crash keeps everything the kernel
+    // has seen, a power loss only what an fdatasync really covered.
+    let intact = match crash {
+        Crash::Process => outcome.acknowledged,
+        Crash::PowerLoss => outcome.synced,
+    };
+    crash_image(&path, &image, crash, intact, &mut rng);
+    writer.close();
+
+    // What must survive.
+    let durable = match (policy, crash) {
+        (_, Crash::Process) | (Policy::Sync, Crash::PowerLoss) => outcome.acknowledged,
+        // Flushed-but-unsynced data carries no power-loss guarantee.
+        (Policy::Flush, Crash::PowerLoss) => 0,
+    };
+    let checked = Outcome {
+        stream: outcome.stream,
+        acknowledged: durable,
+        synced: outcome.synced,
+    };
+    let valid = check_survivors(&image, &checked, crash);
+
+    let (recovered, _, _) = recover(&image);
+    assert_eq!(recovered, valid, "seed {seed}");
+
+    // Appending after recovery continues the record stream seamlessly.
+    let mut tail = Vec::new();
+    encode_record(&mut rng, &mut tail);
+    let mut writer = Writer::open(&image, FileWriterMode::Append);
+    writer.write(&tail);
+    writer.close();
+    let content = fs::read(&image).unwrap();
+    assert_eq!(content.len() as u64, valid + tail.len() as u64);
+    assert_eq!(
+        scan_valid_prefix(&mut content.as_slice()),
+        content.len() as u64
+    );
+}
+
+fn seeds() -> impl Iterator<Item = u64> {
+    let base = std::env::var("FILE_WRITER_CRASH_SEED")
+        .ok()
+        .and_then(|s| s.parse().ok())
+        .unwrap_or(0x5eed);
+    (0..16).map(move |i| base + i)
+}
+
+#[test]
+fn flushed_data_survives_process_crash() {
+    for seed in seeds() {
+        crash_and_recover(Policy::Flush, Crash::Process, seed);
+    }
+}
+
+#[test]
+fn synced_data_survives_power_loss() {
+    for seed in seeds() {
+        crash_and_recover(Policy::Sync, Crash::PowerLoss, seed);
+    }
+}
+
+#[test]
+fn unsynced_data_is_recovered_to_a_record_boundary() {
+    for seed in seeds() {
+        crash_and_recover(Policy::Flush, Crash::PowerLoss, seed);
+    }
+}
+
+#[test]
+fn harness_detects_a_missing_sync() {
+    // Acknowledging with flushes where syncs are promised, as if
+    // file_writer_sync stopped reaching the disk: a power loss must then
+    // damage acknowledged data in at least some runs.
+    let detected = seeds()
+        .filter(|&seed| {
+            std::panic::catch_unwind(|| {
+                crash_and_recover_acknowledging(Policy::Sync, Policy::Flush, Crash::PowerLoss, seed)
+            })
+            .is_err()
+        })
+        .count();
+    assert!(detected > 0, "power loss never hit unsynced data");
+}
+
+#[test]
+#[ignore = "writes multi-GB files; run with --ignored --nocapture"]
+fn recovery_cost_large_files() {
+    let sizes: Vec<u64> = std::env::var("FILE_WRITER_RECOVERY_GIB")
+        .unwrap_or_else(|_| "1".to_string())
+        .split(',')
+        .filter_map(|s| s.trim().parse().ok())
+        .collect();
+
+    for gib in sizes {
+        let dir = TempDir::new().unwrap();
+        let path = dir.path().join("large.log");
+        let target = gib * 1024 * 1024 * 1024;
+        let mut rng = Rng::new(gib);
+
+        let mut writer = Writer::open(&path, FileWriterMode::Write);
+        let mut chunk = Vec::with_capacity(2 * 1024 * 1024);
+        let mut written = 0u64;
+        while written < target {
+            chunk.clear();
+            while chunk.len() < 1024 * 1024 {
+                encode_record(&mut rng, &mut chunk);
+            }
+            writer.write(&chunk);
+            written += chunk.len() as u64;
+        }
+        // Leave a torn record at the tail, like a crash mid-write would.
+        writer.write(&[0xff; 5]);
+        writer.acknowledge(Policy::Sync);
+        writer.close();
+
+        let (valid, scan_time, reopen_time) = recover(&path);
+        assert_eq!(valid, written);
+        let mb = written as f64 / (1024.0 * 1024.0);
+        println!(
+            "recovery {gib} GiB: harness scan+truncate {:.3}s ({:.0} MiB/s), \
+             file_writer reopen(Append) {:.3}ms",
+            scan_time.as_secs_f64(),
+            mb / scan_time.as_secs_f64(),
+            reopen_time.as_secs_f64() * 1e3,
+        );
+    }
+}